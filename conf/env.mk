@@ -14,6 +14,11 @@ V = @
 #
 # GCCPREFIX=''
 
+# Build profile: 'debug' (the default) or 'release'.  A release build
+# compiles out spinlock debugging and the boot-time self-checks.
+#
+# PROFILE = release
+
 # If the makefile cannot find your QEMU binary, uncomment the
 # following line and set it to the full path to QEMU.
 #
@@ -1,13 +1,209 @@
 
 #include "fs.h"
 
+// The block cache holds at most bc_limit blocks, besides the pinned
+// superblock and bitmap blocks.  The cached blocks sit in the slots of
+// bc_slots; when a block is needed and the cache is full, a CLOCK
+// hand sweeps the slots for a victim.  A block whose PTE_A bit is set
+// has been used since the hand last passed: it gets a second chance
+// and its bit is cleared.  The first block found with PTE_A clear is
+// written back if dirty and unmapped.
+//
+// Clearing PTE_A means remapping the page, which also clears PTE_D,
+// so a dirty block is written back when its second chance is given.
+//
+// A cached block is mapped read-only until it is written.  The write
+// faults, and bc_pgfault makes the page writable and appends the block
+// to bc_dirty, so a block is dirty exactly when its page is writable
+// and every dirty block is in bc_dirty.  Writing a block back maps it
+// read-only again but leaves its entry behind; stale and duplicate
+// entries are dropped when the list is compacted.  This way fs_sync
+// only looks at blocks written since the last sync.
+//
+// bc_lock serializes the cache's bookkeeping and the disk among the
+// server's threads, which wait for the disk while holding it.  A block
+// is marked clean before it is written, so that a thread writing to it
+// meanwhile faults and waits; and it is read into BC_STAGE and mapped
+// in place only once it is all there.
+
+static uint32_t bc_slots[BC_MAXBLOCKS];	// Block in each slot, 0 if none
+static int bc_nused;			// Slots [0, bc_nused) are in use
+static int bc_hand;			// Next slot the CLOCK hand looks at
+static int bc_limit = BC_DEFAULT_BLOCKS;
+static struct BcStat bc_stat;
+
+static uint32_t bc_dirty[BC_DIRTYMAX];	// Blocks written since the last sync
+static int bc_ndirtylist;		// Entries in bc_dirty
+static int bc_ndirty;			// Dirty blocks
+
+static struct tlock bc_lock;
+
+// The address of a block, without diskaddr's checks and hit counting.
+#define blockva(blockno)	((void*) (DISKMAP + (blockno) * BLKSIZE))
+
+// Remap the cached page at 'va' with permissions 'perm', which also
+// clears its PTE_A and PTE_D bits.
+static void
+bc_remap(void *va, int perm)
+{
+	int r;
+
+	if ((r = sys_page_map(0, va, 0, va, perm)) < 0)
+		panic("bc_remap %08x: %e", va, r);
+}
+
+// Is the block at 'va' cached and dirty?
+static bool
+bc_is_dirty(void *va)
+{
+	return va_is_mapped(va) && (uvpt[PGNUM(va)] & PTE_W);
+}
+
+// Sort bc_dirty and drop its stale and duplicate entries.
+static void
+bc_dirty_compact(void)
+{
+	int gap, i, j, n = 0;
+	uint32_t blockno;
+
+	for (gap = bc_ndirtylist / 2; gap > 0; gap /= 2)
+		for (i = gap; i < bc_ndirtylist; i++) {
+			blockno = bc_dirty[i];
+			for (j = i; j >= gap && bc_dirty[j - gap] > blockno; j -= gap)
+				bc_dirty[j] = bc_dirty[j - gap];
+			bc_dirty[j] = blockno;
+		}
+	for (i = 0; i < bc_ndirtylist; i++)
+		if (bc_is_dirty(blockva(bc_dirty[i]))
+		    && (n == 0 || bc_dirty[n - 1] != bc_dirty[i]))
+			bc_dirty[n++] = bc_dirty[i];
+	bc_ndirtylist = n;
+}
+
+// The clean cached block 'blockno' is being written: make its page
+// writable and record it as dirty.
+static void
+bc_mark_dirty(uint32_t blockno)
+{
+	if (bc_ndirtylist == BC_DIRTYMAX)
+		bc_dirty_compact();
+	if (bc_ndirtylist == BC_DIRTYMAX)
+		bc_sync();
+	bc_dirty[bc_ndirtylist++] = blockno;
+	bc_ndirty++;
+	bc_remap(blockva(blockno), PTE_P|PTE_U|PTE_W);
+}
+
+// The dirty cached block at 'va' has been written to disk.
+static void
+bc_mark_clean(void *va)
+{
+	bc_ndirty--;
+	bc_remap(va, PTE_P|PTE_U);
+}
+
 // Return the virtual address of this disk block.
 void*
 diskaddr(uint32_t blockno)
 {
+	void *va;
+
 	if (blockno == 0 || (super && blockno >= super->s_nblocks))
 		panic("bad block number %08x in diskaddr", blockno);
-	return (char*) (DISKMAP + blockno * BLKSIZE);
+	va = blockva(blockno);
+	if (va_is_mapped(va))
+		bc_stat.bs_hits++;
+	return va;
+}
+
+// Is this block always in the cache?  The superblock and the bitmap
+// blocks are used on every allocation, so they are never evicted.
+static bool
+bc_pinned(uint32_t blockno)
+{
+	if (blockno == 1)
+		return true;
+	return super && blockno < 2 + (super->s_nblocks + BLKBITSIZE - 1) / BLKBITSIZE;
+}
+
+// Write back the block cached in 'slot' if it is dirty, and drop it.
+static void
+bc_evict(int slot)
+{
+	void *va = blockva(bc_slots[slot]);
+	int r;
+
+	flush_block(va);
+	if ((r = sys_page_unmap(0, va)) < 0)
+		panic("bc_evict: sys_page_unmap: %e", r);
+	bc_slots[slot] = 0;
+	bc_stat.bs_evictions++;
+}
+
+// Find a slot for a block about to be read in, evicting a block with
+// the CLOCK algorithm if the cache is full.
+static int
+bc_slot_alloc(void)
+{
+	uint32_t blockno;
+	void *va;
+	int slot;
+
+	if (bc_nused < bc_limit)
+		return bc_nused++;
+
+	while (1) {
+		slot = bc_hand;
+		bc_hand = (bc_hand + 1) % bc_limit;
+		if ((blockno = bc_slots[slot]) == 0)
+			return slot;
+		va = blockva(blockno);
+		if (!va_is_mapped(va))
+			return slot;
+		if (!(uvpt[PGNUM(va)] & PTE_A)) {
+			bc_evict(slot);
+			return slot;
+		}
+		// Second chance.  flush_block remaps a dirty page; a
+		// clean one must be remapped here to clear PTE_A.
+		if (bc_is_dirty(va))
+			flush_block(va);
+		else
+			bc_remap(va, PTE_P|PTE_U);
+	}
+}
+
+// Change the most blocks the cache may hold (not counting pinned
+// blocks), evicting blocks as needed.  Returns the old limit; a
+// limit of 0 leaves it alone.
+int
+bc_set_limit(int limit)
+{
+	int old = bc_limit, i, j;
+
+	if (limit <= 0)
+		return old;
+	limit = MIN(limit, BC_MAXBLOCKS);
+	tlock_lock(&bc_lock);
+	// Evict the blocks in slots past the new limit.
+	for (i = limit; i < bc_nused; i++)
+		if (bc_slots[i] && va_is_mapped(blockva(bc_slots[i])))
+			bc_evict(i);
+	bc_nused = MIN(bc_nused, limit);
+	bc_hand = 0;
+	bc_limit = limit;
+	tlock_unlock(&bc_lock);
+	return old;
+}
+
+// Fill in the cache counters.
+void
+bc_get_stat(struct BcStat *st)
+{
+	*st = bc_stat;
+	st->bs_limit = bc_limit;
+	st->bs_cached = bc_nused;
+	st->bs_dirty = bc_ndirty;
 }
 
 // Is this virtual address mapped?
@@ -24,6 +220,66 @@ va_is_dirty(void *va)
 	return (uvpt[PGNUM(va)] & PTE_D) != 0;
 }
 
+// Read the 'n' blocks starting at 'blockno', none of which may be
+// cached, into the cache with a single disk command.
+static void
+bc_read(uint32_t blockno, uint32_t n)
+{
+	void *va = blockva(blockno);
+	uint32_t i;
+	int r;
+
+	assert(n > 0 && n <= BC_CLUSTER);
+
+	// Make room first, so that no block of this run is evicted
+	// while the others are being allocated.
+	for (i = 0; i < n; i++) {
+		bc_stat.bs_misses++;
+		if (!bc_pinned(blockno + i))
+			bc_slots[bc_slot_alloc()] = blockno + i;
+	}
+	for (i = 0; i < n; i++)
+		if ((r = sys_page_alloc(0, (void *) BC_STAGE + i * BLKSIZE,
+					PTE_P|PTE_W|PTE_U)) < 0)
+			panic("bc_read: sys_page_alloc: %e", r);
+
+	if ((r = ide_read(blockno * BLKSECTS, (void *) BC_STAGE, n * BLKSECTS)) < 0)
+		panic("bc_read: ide_read: %e", r);
+
+	// The blocks are clean: map them read-only.
+	if ((r = sys_page_map_range(0, (void *) BC_STAGE, 0, va, n * BLKSIZE,
+				    PTE_P|PTE_U)) < 0)
+		panic("bc_read: sys_page_map_range: %e", r);
+	if ((r = sys_page_unmap_range(0, (void *) BC_STAGE, n * BLKSIZE)) < 0)
+		panic("bc_read: sys_page_unmap_range: %e", r);
+}
+
+// Bring the 'n' blocks starting at 'blockno' into the cache, reading
+// each run of blocks that are not cached yet with one disk command.
+// Blocks that would not fit in half the cache are not read.
+void
+bc_prefetch(uint32_t blockno, uint32_t n)
+{
+	uint32_t i, run = 0;
+
+	if (super && blockno + n > super->s_nblocks)
+		n = super->s_nblocks - MIN(blockno, super->s_nblocks);
+	n = MIN(n, (uint32_t) bc_limit / 2);
+	tlock_lock(&bc_lock);
+	for (i = 0; i < n; i++) {
+		if (!va_is_mapped(blockva(blockno + i)) && run < BC_CLUSTER) {
+			run++;
+			continue;
+		}
+		if (run)
+			bc_read(blockno + i - run, run);
+		run = !va_is_mapped(blockva(blockno + i));
+	}
+	if (run)
+		bc_read(blockno + n - run, run);
+	tlock_unlock(&bc_lock);
+}
+
 // Fault any disk block that is read in to memory by
 // loading it from disk.
 static void
@@ -31,7 +287,6 @@ bc_pgfault(struct UTrapframe *utf)
 {
 	void *addr = (void *) utf->utf_fault_va;
 	uint32_t blockno = ((uint32_t)addr - DISKMAP) / BLKSIZE;
-	int r;
 
 	// Check that the fault was within the block cache region
 	if (addr < (void*)DISKMAP || addr >= (void*)(DISKMAP + DISKSIZE))
@@ -42,29 +297,27 @@ bc_pgfault(struct UTrapframe *utf)
 	if (super && blockno >= super->s_nblocks)
 		panic("reading non-existent block %08x\n", blockno);
 
-	// Allocate a page in the disk map region, read the contents
-	// of the block from the disk into that page.
-	// Hint: first round addr to page boundary. fs/ide.c has code to read
-	// the disk.
-	//
-	// LAB 5: you code here:
-	addr = ROUNDDOWN(addr, PGSIZE);
-	r = sys_page_alloc(0, (void *)addr, PTE_P | PTE_W | PTE_U);
-	if(r < 0) panic("[fs/bc.c] bc_pgfault sys_page_alloc error: %e", r);
-
-	r = ide_read(blockno * BLKSECTS, addr, BLKSECTS);
-	if(r < 0) panic("[fs/bc.c] bc_pgfault ide_read error: %e", r);
-
-	// Clear the dirty bit for the disk block page since we just read the
-	// block from disk
-	if ((r = sys_page_map(0, addr, 0, addr, uvpt[PGNUM(addr)] & PTE_SYSCALL)) < 0)
-		panic("in bc_pgfault, sys_page_map: %e", r);
+	// A cached block faults only when a clean one is written.
+	if (va_is_mapped(addr)
+	    && (!(utf->utf_err & FEC_WR) || bc_is_dirty(addr)))
+		panic("page fault in FS: eip %08x, va %08x, err %04x",
+		      utf->utf_eip, addr, utf->utf_err);
 
-	// Check that the block we read was allocated. (exercise for
-	// the reader: why do we do this *after* reading the block
-	// in?)
-	if (bitmap && block_is_free(blockno))
-		panic("reading free block %08x\n", blockno);
+	// While we wait for the lock, another thread may read the block
+	// in, mark it dirty or evict it.
+	tlock_lock(&bc_lock);
+	if (!va_is_mapped(addr)) {
+		bc_read(blockno, 1);
+
+		// Check that the block we read was allocated. (exercise
+		// for the reader: why do we do this *after* reading the
+		// block in?)
+		if (bitmap && block_is_free(blockno))
+			panic("reading free block %08x\n", blockno);
+	}
+	if ((utf->utf_err & FEC_WR) && !bc_is_dirty(addr))
+		bc_mark_dirty(blockno);
+	tlock_unlock(&bc_lock);
 }
 
 // Flush the contents of the block containing VA out to disk if
@@ -84,15 +337,85 @@ flush_block(void *addr)
 
 	// LAB 5: Your code here.
 	addr = ROUNDDOWN(addr, PGSIZE);
-	if(va_is_mapped(addr) && va_is_dirty(addr)){
+	tlock_lock(&bc_lock);
+	if(bc_is_dirty(addr)){
+		bc_mark_clean(addr);
 		ide_write(blockno*BLKSECTS, addr, BLKSECTS);
-		int r = sys_page_map(0, addr, 0, addr, uvpt[PGNUM(addr)] & PTE_SYSCALL);
-		if(r < 0) panic("[fs/bc.c] flush_block sys_page_map error: %e", r);
 	}
+	tlock_unlock(&bc_lock);
 
 	// panic("flush_block not implemented");
 }
 
+// Write the 'n' cached blocks starting at 'blockno' to disk with a
+// single disk command and mark them clean.
+static void
+bc_write(uint32_t blockno, uint32_t n)
+{
+	void *va = blockva(blockno);
+	uint32_t i;
+	int r;
+
+	for (i = 0; i < n; i++)
+		bc_mark_clean(va + i * BLKSIZE);
+	if ((r = ide_write(blockno * BLKSECTS, va, n * BLKSECTS)) < 0)
+		panic("bc_write: ide_write: %e", r);
+}
+
+// Write back the dirty blocks among the 'n' starting at 'blockno',
+// merging each run of adjacent dirty blocks into one disk command.
+void
+bc_flush_range(uint32_t blockno, uint32_t n)
+{
+	uint32_t i, run = 0;
+	void *va;
+
+	tlock_lock(&bc_lock);
+	for (i = 0; i < n; i++) {
+		va = blockva(blockno + i);
+		if (bc_is_dirty(va) && run < BC_CLUSTER) {
+			run++;
+			continue;
+		}
+		if (run)
+			bc_write(blockno + i - run, run);
+		run = bc_is_dirty(va);
+	}
+	if (run)
+		bc_write(blockno + n - run, run);
+	tlock_unlock(&bc_lock);
+}
+
+// Write back every dirty block, merging runs of adjacent blocks.
+void
+bc_sync(void)
+{
+	int i, run = 0;
+
+	tlock_lock(&bc_lock);
+	bc_dirty_compact();
+	for (i = 0; i < bc_ndirtylist; i++) {
+		if (run && bc_dirty[i] == bc_dirty[i - 1] + 1 && run < BC_CLUSTER) {
+			run++;
+			continue;
+		}
+		if (run)
+			bc_write(bc_dirty[i - run], run);
+		run = 1;
+	}
+	if (run)
+		bc_write(bc_dirty[i - run], run);
+	bc_ndirtylist = 0;
+	tlock_unlock(&bc_lock);
+}
+
+// Return the number of dirty blocks.
+int
+bc_dirty_count(void)
+{
+	return bc_ndirty;
+}
+
 // Test that the block cache works, by smashing the superblock and
 // reading it back.
 static void
@@ -156,7 +479,9 @@ bc_init(void)
 {
 	struct Super super;
 	set_pgfault_handler(bc_pgfault);
+#ifndef JOS_RELEASE
 	check_bc();
+#endif
 
 	// cache the super block by reading it once
 	memmove(&super, diskaddr(1), sizeof super);
@@ -0,0 +1,97 @@
+/*
+ * Directory entry cache.
+ *
+ * Remembers the result of recent dir_lookup calls, keyed by directory
+ * and name: the File found and its slot, or that the name is not there.
+ * File structures never move (they live at fixed addresses in the disk
+ * map), so a cached pointer stays good until the file is removed.
+ * file_create and file_remove update the cache; nothing else changes
+ * what a name refers to.
+ */
+
+#include "fs.h"
+
+// Names longer than this are looked up without the cache.
+#define DCACHE_NAMELEN	32
+#define NDCACHE		512
+
+struct Dentry {
+	struct File *d_dir;		// directory, or NULL if unused
+	struct File *d_file;		// file, or NULL if the name is not there
+	uint32_t d_slot;
+	char d_name[DCACHE_NAMELEN];
+};
+
+static struct Dentry dcache[NDCACHE];
+static uint32_t dcache_hits, dcache_neg_hits, dcache_misses;
+
+// Return the cache entry that (dir, name) maps to, or NULL if the name
+// is too long to cache.
+static struct Dentry *
+dcache_slot(struct File *dir, const char *name)
+{
+	uint32_t h;
+
+	if (strlen(name) >= DCACHE_NAMELEN)
+		return NULL;
+	h = dirhash(name) ^ ((uintptr_t) dir / sizeof(struct File)) * 2654435761U;
+	return &dcache[h % NDCACHE];
+}
+
+// Look (dir, name) up in the cache.  If it is there, set *file to the
+// file it names, or NULL if the name is known not to exist, and *slot
+// to its slot, and return 1.  Otherwise return 0.
+int
+dcache_lookup(struct File *dir, const char *name, struct File **file,
+	      uint32_t *slot)
+{
+	struct Dentry *d = dcache_slot(dir, name);
+
+	if (!d || d->d_dir != dir || strcmp(d->d_name, name) != 0) {
+		dcache_misses++;
+		return 0;
+	}
+	if (d->d_file)
+		dcache_hits++;
+	else
+		dcache_neg_hits++;
+	*file = d->d_file;
+	*slot = d->d_slot;
+	return 1;
+}
+
+// Record that 'name' in dir is 'file', at 'slot', or that it does not
+// exist if file is NULL.
+void
+dcache_enter(struct File *dir, const char *name, struct File *file,
+	     uint32_t slot)
+{
+	struct Dentry *d = dcache_slot(dir, name);
+
+	if (!d)
+		return;
+	d->d_dir = dir;
+	d->d_file = file;
+	d->d_slot = slot;
+	strcpy(d->d_name, name);
+}
+
+// Forget every entry in the directory dir, which is being removed.
+void
+dcache_purge(struct File *dir)
+{
+	int i;
+
+	for (i = 0; i < NDCACHE; i++)
+		if (dcache[i].d_dir == dir)
+			dcache[i].d_dir = NULL;
+}
+
+// Fill in the cache counters.
+void
+dcache_get_stat(struct BcStat *st)
+{
+	st->bs_dhits = dcache_hits;
+	st->bs_dneg_hits = dcache_neg_hits;
+	st->bs_dmisses = dcache_misses;
+}
@@ -0,0 +1,168 @@
+/*
+ * Directory name index.
+ *
+ * A directory whose f_dirindex is set keeps an extendible hash table
+ * (see struct DirIndex in inc/fs.h) from the hash of each name to its
+ * directory slot, so dir_lookup reads one leaf block and compares
+ * names only on a hash match.  Directories without an index are
+ * searched linearly by fs.c.
+ */
+
+#include "fs.h"
+
+// Return the leaf that 'hash' belongs in.
+static struct DirLeaf *
+dirindex_leaf(struct DirIndex *di, uint32_t hash)
+{
+	return diskaddr(di->di_leaf[hash & ((1 << di->di_depth) - 1)]);
+}
+
+// Look up 'name' in the index of dir.  On success set *file to its
+// entry and *slot to its slot.
+// Returns 0 on success, -E_NOT_FOUND if the name is not there, or
+// another error reading the directory.
+int
+dirindex_lookup(struct File *dir, const char *name, struct File **file,
+		uint32_t *slot)
+{
+	struct DirLeaf *dl;
+	struct File *f;
+	uint32_t hash = dirhash(name), i;
+	char *blk;
+	int r;
+
+	dl = dirindex_leaf(diskaddr(dir->f_dirindex), hash);
+	for (i = 0; i < dl->dl_count; i++) {
+		if (dl->dl_ent[i].de_hash != hash)
+			continue;
+		if ((r = file_get_block(dir, dl->dl_ent[i].de_slot / BLKFILES,
+					&blk)) < 0)
+			return r;
+		f = (struct File *) blk + dl->dl_ent[i].de_slot % BLKFILES;
+		if (strcmp(f->f_name, name) == 0) {
+			*file = f;
+			*slot = dl->dl_ent[i].de_slot;
+			return 0;
+		}
+	}
+	return -E_NOT_FOUND;
+}
+
+// Split the full leaf that 'hash' belongs in, doubling the root's
+// table first if the leaf uses as many bits as the root.
+// Returns 0 on success, < 0 on error.
+static int
+dirindex_split(struct DirIndex *di, uint32_t hash)
+{
+	struct DirLeaf *dl, *nl;
+	uint32_t oldb, bit, i, n;
+	int r;
+
+	oldb = di->di_leaf[hash & ((1 << di->di_depth) - 1)];
+	dl = diskaddr(oldb);
+	if (dl->dl_depth == di->di_depth) {
+		if (di->di_depth == DIRINDEX_MAXDEPTH)
+			return -E_NO_DISK;
+		for (i = 0; i < (1 << di->di_depth); i++)
+			di->di_leaf[i + (1 << di->di_depth)] = di->di_leaf[i];
+		di->di_depth++;
+	}
+
+	if ((r = alloc_block()) < 0)
+		return r;
+	nl = diskaddr(r);
+	memset(nl, 0, BLKSIZE);
+	bit = 1 << dl->dl_depth;
+	dl->dl_depth++;
+	nl->dl_depth = dl->dl_depth;
+
+	// Entries with the new bit set move to the new leaf.
+	for (i = n = 0; i < dl->dl_count; i++)
+		if (dl->dl_ent[i].de_hash & bit)
+			nl->dl_ent[nl->dl_count++] = dl->dl_ent[i];
+		else
+			dl->dl_ent[n++] = dl->dl_ent[i];
+	dl->dl_count = n;
+	for (i = 0; i < (1 << di->di_depth); i++)
+		if (di->di_leaf[i] == oldb && (i & bit))
+			di->di_leaf[i] = r;
+	return 0;
+}
+
+// Add 'name', stored in directory slot 'slot', to the index of dir.
+// Returns 0 on success, < 0 on error.
+int
+dirindex_insert(struct File *dir, const char *name, uint32_t slot)
+{
+	struct DirIndex *di = diskaddr(dir->f_dirindex);
+	struct DirLeaf *dl;
+	uint32_t hash = dirhash(name);
+	int r;
+
+	while ((dl = dirindex_leaf(di, hash))->dl_count == NLEAFENTS)
+		if ((r = dirindex_split(di, hash)) < 0)
+			return r;
+	dl->dl_ent[dl->dl_count].de_hash = hash;
+	dl->dl_ent[dl->dl_count].de_slot = slot;
+	dl->dl_count++;
+	return 0;
+}
+
+// Remove 'name', stored in directory slot 'slot', from the index of
+// dir, and note that the slot is free.
+void
+dirindex_remove(struct File *dir, const char *name, uint32_t slot)
+{
+	struct DirIndex *di = diskaddr(dir->f_dirindex);
+	struct DirLeaf *dl;
+	uint32_t i;
+
+	dl = dirindex_leaf(di, dirhash(name));
+	for (i = 0; i < dl->dl_count; i++)
+		if (dl->dl_ent[i].de_slot == slot) {
+			dl->dl_ent[i] = dl->dl_ent[--dl->dl_count];
+			break;
+		}
+	di->di_freehint = MIN(di->di_freehint, slot);
+}
+
+// Give dir an empty index.
+// Returns 0 on success, < 0 on error.
+int
+dirindex_create(struct File *dir)
+{
+	struct DirIndex *di;
+	int r, leaf;
+
+	if ((r = alloc_block()) < 0)
+		return r;
+	if ((leaf = alloc_block()) < 0) {
+		free_block(r);
+		return leaf;
+	}
+	memset(diskaddr(leaf), 0, BLKSIZE);
+	di = diskaddr(r);
+	memset(di, 0, BLKSIZE);
+	di->di_leaf[0] = leaf;
+	dir->f_dirindex = r;
+	return 0;
+}
+
+// Free the index of dir.
+void
+dirindex_free(struct File *dir)
+{
+	struct DirIndex *di = diskaddr(dir->f_dirindex);
+	struct DirLeaf *dl;
+	uint32_t i;
+
+	// A leaf appears in the table 1 << (di_depth - dl_depth) times,
+	// first at the index given by its low dl_depth bits.
+	for (i = 0; i < (1 << di->di_depth); i++) {
+		dl = diskaddr(di->di_leaf[i]);
+		if (i < (1 << dl->dl_depth))
+			free_block(di->di_leaf[i]);
+	}
+	free_block(dir->f_dirindex);
+	dir->f_dirindex = 0;
+}
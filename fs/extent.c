@@ -0,0 +1,226 @@
+/*
+ * Extent-mapped files.
+ *
+ * A file with FILE_EXTENTS set describes its blocks as a sorted list
+ * of extents: the first NFEXTENTS live in the File itself and the rest
+ * in a chain of extent blocks.  A file written sequentially on a disk
+ * with contiguous free space maps with a handful of extents no matter
+ * how large it grows.
+ */
+
+#include "fs.h"
+
+// The extent each file last found a block in, indexed by the File's
+// address.  Sequential access through an open file mostly hits here
+// and never searches the extent list.
+#define NEXTCACHE	32
+
+static struct {
+	struct File *f;
+	struct Extent e;
+} extcache[NEXTCACHE];
+
+#define extcache_slot(f) \
+	(&extcache[((uintptr_t) (f) / sizeof(struct File)) % NEXTCACHE])
+
+// Forget the cached extent of f, whose extents are changing.
+static void
+ext_uncache(struct File *f)
+{
+	if (extcache_slot(f)->f == f)
+		extcache_slot(f)->f = NULL;
+}
+
+// Return a pointer to f's i'th extent, which must be within the space
+// of f's extent blocks.
+static struct Extent *
+ext_get(struct File *f, uint32_t i)
+{
+	struct ExtentBlock *eb;
+
+	if (i < NFEXTENTS)
+		return &f->f_extent[i];
+	i -= NFEXTENTS;
+	for (eb = diskaddr(f->f_extblock); i >= NBLKEXTENTS;
+	     eb = diskaddr(eb->eb_next))
+		i -= NBLKEXTENTS;
+	return &eb->eb_extent[i];
+}
+
+// Return the number of extents before the first one that starts after
+// file block 'filebno'.
+static uint32_t
+ext_search(struct File *f, uint32_t filebno)
+{
+	uint32_t lo = 0, hi = f->f_nextents, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (ext_get(f, mid)->e_lblk <= filebno)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// Set *diskbno to the disk block holding file block 'filebno' of f,
+// or to 0 if the block is not allocated.
+void
+ext_lookup(struct File *f, uint32_t filebno, uint32_t *diskbno)
+{
+	struct Extent *e;
+	uint32_t i;
+
+	e = &extcache_slot(f)->e;
+	if (extcache_slot(f)->f != f
+	    || filebno - e->e_lblk >= e->e_len) {
+		*diskbno = 0;
+		if ((i = ext_search(f, filebno)) == 0)
+			return;
+		e = ext_get(f, i - 1);
+		if (filebno - e->e_lblk >= e->e_len)
+			return;
+		extcache_slot(f)->f = f;
+		extcache_slot(f)->e = *e;
+	}
+	*diskbno = e->e_pblk + (filebno - e->e_lblk);
+}
+
+// Make room for one more extent, adding an extent block to the chain
+// if the ones f has are full.
+// Returns 0 on success, < 0 on error.
+static int
+ext_grow(struct File *f)
+{
+	struct ExtentBlock *eb = NULL;
+	uint32_t cap = NFEXTENTS, b;
+	int r;
+
+	for (b = f->f_extblock; b; b = eb->eb_next) {
+		eb = diskaddr(b);
+		cap += NBLKEXTENTS;
+	}
+	if (f->f_nextents < cap)
+		return 0;
+	if ((r = alloc_block()) < 0)
+		return r;
+	memset(diskaddr(r), 0, BLKSIZE);
+	if (eb)
+		eb->eb_next = r;
+	else
+		f->f_extblock = r;
+	return 0;
+}
+
+// Remove f's i'th extent.
+static void
+ext_delete(struct File *f, uint32_t i)
+{
+	for (; i + 1 < f->f_nextents; i++)
+		*ext_get(f, i) = *ext_get(f, i + 1);
+	f->f_nextents--;
+}
+
+// Map the unallocated file block 'filebno' of f to disk block
+// 'diskbno', growing a neighboring extent when the two are contiguous.
+// Returns 0 on success, < 0 on error.
+int
+ext_insert(struct File *f, uint32_t filebno, uint32_t diskbno)
+{
+	struct Extent *prev = NULL, *next = NULL;
+	uint32_t i, pos;
+	int r;
+
+	ext_uncache(f);
+	pos = ext_search(f, filebno);
+	if (pos > 0)
+		prev = ext_get(f, pos - 1);
+	if (pos < f->f_nextents)
+		next = ext_get(f, pos);
+
+	if (prev && prev->e_lblk + prev->e_len == filebno
+	    && prev->e_pblk + prev->e_len == diskbno) {
+		prev->e_len++;
+		// The block may also join prev to next.
+		if (next && next->e_lblk == filebno + 1
+		    && next->e_pblk == diskbno + 1) {
+			prev->e_len += next->e_len;
+			ext_delete(f, pos);
+		}
+		return 0;
+	}
+	if (next && next->e_lblk == filebno + 1 && next->e_pblk == diskbno + 1) {
+		next->e_lblk--;
+		next->e_pblk--;
+		next->e_len++;
+		return 0;
+	}
+
+	if ((r = ext_grow(f)) < 0)
+		return r;
+	for (i = f->f_nextents; i > pos; i--)
+		*ext_get(f, i) = *ext_get(f, i - 1);
+	next = ext_get(f, pos);
+	next->e_lblk = filebno;
+	next->e_pblk = diskbno;
+	next->e_len = 1;
+	f->f_nextents++;
+	return 0;
+}
+
+// Free the blocks of f from file block 'nblocks' on, and any extent
+// blocks no longer needed.
+void
+ext_truncate(struct File *f, uint32_t nblocks)
+{
+	struct Extent *e;
+	struct ExtentBlock *eb;
+	uint32_t b, next, keep, i;
+
+	ext_uncache(f);
+	while (f->f_nextents > 0) {
+		e = ext_get(f, f->f_nextents - 1);
+		if (e->e_lblk + e->e_len <= nblocks)
+			break;
+		keep = nblocks > e->e_lblk ? nblocks - e->e_lblk : 0;
+		for (i = keep; i < e->e_len; i++)
+			free_block(e->e_pblk + i);
+		if ((e->e_len = keep) > 0)
+			break;
+		f->f_nextents--;
+	}
+
+	// Keep just enough extent blocks for the extents left.
+	keep = f->f_nextents <= NFEXTENTS ? 0 :
+		ROUNDUP(f->f_nextents - NFEXTENTS, NBLKEXTENTS) / NBLKEXTENTS;
+	if (keep == 0) {
+		b = f->f_extblock;
+		f->f_extblock = 0;
+	} else {
+		for (eb = diskaddr(f->f_extblock); keep > 1; keep--)
+			eb = diskaddr(eb->eb_next);
+		b = eb->eb_next;
+		eb->eb_next = 0;
+	}
+	for (; b; b = next) {
+		next = ((struct ExtentBlock *) diskaddr(b))->eb_next;
+		free_block(b);
+	}
+}
+
+// Write back the dirty blocks of f and its extent blocks, each extent
+// with as few disk commands as bc_flush_range needs.
+void
+ext_flush(struct File *f)
+{
+	struct Extent *e;
+	uint32_t i, b;
+
+	for (i = 0; i < f->f_nextents; i++) {
+		e = ext_get(f, i);
+		bc_flush_range(e->e_pblk, e->e_len);
+	}
+	for (b = f->f_extblock; b; b = ((struct ExtentBlock *) diskaddr(b))->eb_next)
+		flush_block(diskaddr(b));
+}
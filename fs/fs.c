@@ -24,6 +24,18 @@ check_super(void)
 // Free block bitmap
 // --------------------------------------------------------------
 
+// Free space summary, built by alloc_init: the number of free blocks
+// described by each bitmap block, and on the whole disk.  The search
+// for free blocks scans the bitmap a word at a time, starting at
+// alloc_hint (just past the last allocation) and skipping bitmap
+// blocks with no free blocks.
+#define NBITMAPBLOCKS	(DISKSIZE / BLKSIZE / BLKBITSIZE)
+#define BITMAPWORDS	(BLKBITSIZE / 32)	// Words per bitmap block
+
+static uint32_t bitmap_nfree[NBITMAPBLOCKS];
+static uint32_t nfree;
+static uint32_t alloc_hint;
+
 // Check to see if the block bitmap indicates that block 'blockno' is free.
 // Return 1 if the block is free, 0 if not.
 bool
@@ -43,32 +55,99 @@ free_block(uint32_t blockno)
 	// Blockno zero is the null pointer of block numbers.
 	if (blockno == 0)
 		panic("attempt to free zero block");
+	if (block_is_free(blockno))
+		return;
 	bitmap[blockno/32] |= 1<<(blockno%32);
+	bitmap_nfree[blockno / BLKBITSIZE]++;
+	nfree++;
+}
+
+// Mark the free block 'blockno' in use.
+static void
+use_block(uint32_t blockno)
+{
+	bitmap[blockno/32] &= ~(1<<(blockno%32));
+	bitmap_nfree[blockno / BLKBITSIZE]--;
+	nfree--;
+}
+
+// Find a free block in bitmap words [w, end).
+// Returns the block number, or 0 if there is none.
+static uint32_t
+find_free_words(uint32_t w, uint32_t end)
+{
+	uint32_t blockno;
+
+	for (; w < end; w++) {
+		if (bitmap_nfree[w / BITMAPWORDS] == 0) {
+			// Skip the rest of this bitmap block.
+			w = ROUNDUP(w + 1, BITMAPWORDS) - 1;
+			continue;
+		}
+		if (bitmap[w] == 0)
+			continue;
+		blockno = w * 32 + __builtin_ctz(bitmap[w]);
+		if (blockno != 0 && blockno < super->s_nblocks)
+			return blockno;
+	}
+	return 0;
+}
+
+// Find a free block, looking first at 'goal', then onward from the
+// allocation hint.  Returns the block number, or 0 if the disk is full.
+static uint32_t
+find_free(uint32_t goal)
+{
+	uint32_t nwords = ROUNDUP(super->s_nblocks, 32) / 32, start, blockno;
+
+	if (nfree == 0)
+		return 0;
+	if (goal != 0 && block_is_free(goal))
+		return goal;
+	start = (alloc_hint < super->s_nblocks ? alloc_hint : 0) / 32;
+	if ((blockno = find_free_words(start, nwords)) != 0)
+		return blockno;
+	return find_free_words(0, start);
 }
 
-// Search the bitmap for a free block and allocate it.  When you
-// allocate a block, immediately flush the changed bitmap block
-// to disk.
+// Allocate up to 'want' blocks that are contiguous on disk, preferring
+// to start at block 'goal' (0 for no preference).  Sets *got to the
+// number allocated, which is at least 1.  The changed bitmap blocks
+// are left dirty for the write-back flusher (or the next file_flush
+// or fs_sync) to write out.
+//
+// Returns the first block allocated, or -E_NO_DISK if the disk is full.
+int
+alloc_block_run(uint32_t goal, uint32_t want, uint32_t *got)
+{
+	uint32_t blockno, n;
+
+	if ((blockno = find_free(goal)) == 0)
+		return -E_NO_DISK;
+	for (n = 0; n < MAX(want, 1) && block_is_free(blockno + n); n++)
+		use_block(blockno + n);
+	alloc_hint = blockno + n;
+	*got = n;
+	return blockno;
+}
+
+// Search the bitmap for a free block and allocate it.
 //
 // Return block number allocated on success,
 // -E_NO_DISK if we are out of blocks.
-//
-// Hint: use free_block as an example for manipulating the bitmap.
 int
 alloc_block(void)
 {
-	// The bitmap consists of one or more blocks.  A single bitmap block
-	// contains the in-use bits for BLKBITSIZE blocks.  There are
-	// super->s_nblocks blocks in the disk altogether.
-	for(int i=1; i < super->s_nblocks; i++){
-		if(block_is_free(i)){
-			bitmap[i / 32] &= ~(1 << (i % 32));
-			flush_block(&bitmap[i / 32]);
-			return i;
-		}
-	}
-	// LAB 5: Your code here.
-	return -E_NO_DISK;
+	uint32_t got;
+
+	return alloc_block_run(0, 1, &got);
+}
+
+// Return the number of free blocks on the disk.
+uint32_t
+free_block_count(void)
+{
+	return nfree;
 }
 
 // Validate the file system bitmap.
@@ -91,6 +170,22 @@ check_bitmap(void)
 	cprintf("bitmap is good\n");
 }
 
+// Count the free blocks described by each bitmap block.
+static void
+alloc_init(void)
+{
+	uint32_t i;
+
+	nfree = 0;
+	memset(bitmap_nfree, 0, sizeof(bitmap_nfree));
+	for (i = 1; i < super->s_nblocks; i++)
+		if (block_is_free(i)) {
+			bitmap_nfree[i / BLKBITSIZE]++;
+			nfree++;
+		}
+	alloc_hint = 0;
+}
+
 // --------------------------------------------------------------
 // File system structures
 // --------------------------------------------------------------
@@ -111,6 +206,7 @@ fs_init(void)
 	else
 		ide_set_disk(0);
 	bc_init();
+	ra_max = RA_MAX;
 
 	// Set "super" to point to the super block.
 	super = diskaddr(1);
@@ -119,6 +215,7 @@ fs_init(void)
 	// Set "bitmap" to the beginning of the first bitmap block.
 	bitmap = diskaddr(2);
 	check_bitmap();
+	alloc_init();
 	
 }
 
@@ -155,12 +252,11 @@ file_block_walk(struct File *f, uint32_t filebno, uint32_t **ppdiskbno, bool all
 		// alloc f_indirect block
 		if(!(f->f_indirect)){
 			if(alloc == 0) return -E_NOT_FOUND;
-			uint32_t blockno;
+			int blockno;
 			blockno = alloc_block();
 			if(blockno < 0) return blockno;
 			f->f_indirect = blockno;
 			memset(diskaddr(blockno), 0, BLKSIZE);
-			flush_block(diskaddr(blockno));
 		}
 		filebno = filebno - NDIRECT;
 		*ppdiskbno = (uint32_t *)diskaddr(f->f_indirect) + filebno;
@@ -178,6 +274,99 @@ file_block_walk(struct File *f, uint32_t filebno, uint32_t **ppdiskbno, bool all
 
 }
 
+// Set *diskbno to the disk block holding the 'filebno'th block of
+// file 'f', or to 0 if that block is not allocated.
+//
+// Returns 0 on success, -E_INVAL if filebno is out of range.
+int
+file_map_block(struct File *f, uint32_t filebno, uint32_t *diskbno)
+{
+	uint32_t *pdiskbno;
+	int r;
+
+	if (f->f_flags & FILE_EXTENTS) {
+		ext_lookup(f, filebno, diskbno);
+		return 0;
+	}
+	*diskbno = 0;
+	if ((r = file_block_walk(f, filebno, &pdiskbno, 0)) < 0)
+		return r == -E_NOT_FOUND ? 0 : r;
+	*diskbno = *pdiskbno;
+	return 0;
+}
+
+// Map the unallocated 'filebno'th block of file 'f' to disk block
+// 'diskbno'.
+//
+// Returns 0 on success, < 0 on error.
+static int
+file_set_block(struct File *f, uint32_t filebno, uint32_t diskbno)
+{
+	uint32_t *pdiskbno;
+	int r;
+
+	if (f->f_flags & FILE_EXTENTS)
+		return ext_insert(f, filebno, diskbno);
+	if ((r = file_block_walk(f, filebno, &pdiskbno, 1)) < 0)
+		return r;
+	*pdiskbno = diskbno;
+	return 0;
+}
+
+// Is file block 'filebno' of f missing a disk block?
+static bool
+file_block_missing(struct File *f, uint32_t filebno)
+{
+	uint32_t diskbno;
+
+	return file_map_block(f, filebno, &diskbno) < 0 || diskbno == 0;
+}
+
+// Give each of file blocks [filebno, filebno + n) of f that has no
+// disk block a zeroed one.  Each run of missing blocks is allocated
+// contiguously on disk where possible, right after the disk block of
+// the file block before it.
+//
+// Returns 0 on success, < 0 on error.
+static int
+file_alloc_blocks(struct File *f, uint32_t filebno, uint32_t n)
+{
+	uint32_t diskbno, i, j, goal = 0, next = 0, got = 0;
+	int r;
+
+	if (filebno > 0 && file_map_block(f, filebno - 1, &diskbno) >= 0
+	    && diskbno != 0)
+		goal = diskbno + 1;
+	for (i = filebno; i < filebno + n; i++) {
+		if ((r = file_map_block(f, i, &diskbno)) < 0)
+			goto fail;
+		if (diskbno == 0) {
+			if (got == 0) {
+				for (j = i + 1; j < filebno + n && file_block_missing(f, j); j++)
+					;
+				if ((r = alloc_block_run(goal, j - i, &got)) < 0)
+					return r;
+				next = r;
+			}
+			diskbno = next++;
+			got--;
+			if ((r = file_set_block(f, i, diskbno)) < 0) {
+				free_block(diskbno);
+				goto fail;
+			}
+			memset(diskaddr(diskbno), 0, BLKSIZE);
+		}
+		goal = diskbno + 1;
+	}
+	return 0;
+
+    fail:
+	// Give back the rest of the last run.
+	for (; got > 0; got--)
+		free_block(next++);
+	return r;
+}
+
 // Set *blk to the address in memory where the filebno'th
 // block of file 'f' would be mapped.
 //
@@ -190,36 +379,40 @@ int
 file_get_block(struct File *f, uint32_t filebno, char **blk)
 {
 	// LAB 5: Your code here.
-	uint32_t *pdiskbno;
+	uint32_t diskbno;
 	int r;
-	r = file_block_walk(f, filebno, &pdiskbno, 1);
+	r = file_map_block(f, filebno, &diskbno);
 	if(r < 0) return r;
 
 
-	if(*pdiskbno == 0){
-		r = alloc_block();
-		if(r < 0) return r;
-		*pdiskbno = r;
-		memset(diskaddr(r), 0, BLKSIZE);
-		flush_block(diskaddr(r));
+	if(diskbno == 0){
+		if ((r = file_alloc_blocks(f, filebno, 1)) < 0)
+			return r;
+		file_map_block(f, filebno, &diskbno);
 	}
 
-	*blk = diskaddr(*pdiskbno);
+	*blk = diskaddr(diskbno);
 	return 0;
 }
 
-// Try to find a file named "name" in dir.  If so, set *file to it.
+// Search dir for a file named "name".  If found, set *file to it
+// and *slot to its slot, the entry's number within the directory.
+// Directories with an index are searched through it, others linearly.
 //
 // Returns 0 and sets *file on success, < 0 on error.  Errors are:
 //	-E_NOT_FOUND if the file is not found
 static int
-dir_lookup(struct File *dir, const char *name, struct File **file)
+dir_search(struct File *dir, const char *name, struct File **file,
+	   uint32_t *slot)
 {
 	int r;
 	uint32_t i, j, nblock;
 	char *blk;
 	struct File *f;
 
+	if (dir->f_dirindex)
+		return dirindex_lookup(dir, name, file, slot);
+
 	// Search dir for name.
 	// We maintain the invariant that the size of a directory-file
 	// is always a multiple of the file system's block size.
@@ -235,6 +428,7 @@ dir_lookup(struct File *dir, const char *name, struct File **file)
 			// cprintf("strcmp result is %d\n", strcmp(f[j].f_name, name));
 			if (strcmp(f[j].f_name, name) == 0) {
 				*file = &f[j];
+				*slot = i * BLKFILES + j;
 				return 0;
 			}
 		}
@@ -242,33 +436,61 @@ dir_lookup(struct File *dir, const char *name, struct File **file)
 	return -E_NOT_FOUND;
 }
 
-// Set *file to point at a free File structure in dir.  The caller is
-// responsible for filling in the File fields.
+// Like dir_search, but try the directory entry cache first and
+// remember the result there.
 static int
-dir_alloc_file(struct File *dir, struct File **file)
+dir_lookup(struct File *dir, const char *name, struct File **file,
+	   uint32_t *slot)
 {
 	int r;
-	uint32_t nblock, i, j;
+
+	if (dcache_lookup(dir, name, file, slot))
+		return *file ? 0 : -E_NOT_FOUND;
+	r = dir_search(dir, name, file, slot);
+	if (r == 0)
+		dcache_enter(dir, name, *file, *slot);
+	else if (r == -E_NOT_FOUND)
+		dcache_enter(dir, name, NULL, 0);
+	return r;
+}
+
+// Set *file to point at a free File structure in dir, and *slot to
+// its slot.  The caller is responsible for filling in the File fields.
+// An indexed directory's search starts at its free-slot hint.
+static int
+dir_alloc_file(struct File *dir, struct File **file, uint32_t *slot)
+{
+	int r;
+	uint32_t nblock, i, j, first = 0;
 	char *blk;
 	struct File *f;
+	struct DirIndex *di = NULL;
 
 	assert((dir->f_size % BLKSIZE) == 0);
+	if (dir->f_dirindex) {
+		di = diskaddr(dir->f_dirindex);
+		first = di->di_freehint;
+	}
 	nblock = dir->f_size / BLKSIZE;
-	for (i = 0; i < nblock; i++) {
+	for (i = first / BLKFILES; i < nblock; i++) {
 		if ((r = file_get_block(dir, i, &blk)) < 0)
 			return r;
 		f = (struct File*) blk;
-		for (j = 0; j < BLKFILES; j++)
-			if (f[j].f_name[0] == '\0') {
-				*file = &f[j];
-				return 0;
-			}
+		for (j = (i == first / BLKFILES ? first % BLKFILES : 0); j < BLKFILES; j++)
+			if (f[j].f_name[0] == '\0')
+				goto found;
 	}
 	dir->f_size += BLKSIZE;
 	if ((r = file_get_block(dir, i, &blk)) < 0)
 		return r;
 	f = (struct File*) blk;
-	*file = &f[0];
+	j = 0;
+
+    found:
+	*file = &f[j];
+	*slot = i * BLKFILES + j;
+	if (di)
+		di->di_freehint = *slot + 1;
 	return 0;
 }
 
@@ -293,6 +515,7 @@ walk_path(const char *path, struct File **pdir, struct File **pf, char *lastelem
 	const char *p;
 	char name[MAXNAMELEN];
 	struct File *dir, *f;
+	uint32_t slot;
 	int r;
 
 	// if (*path != '/')
@@ -319,7 +542,7 @@ walk_path(const char *path, struct File **pdir, struct File **pf, char *lastelem
 		if (dir->f_type != FTYPE_DIR)
 			return -E_NOT_FOUND;
 
-		if ((r = dir_lookup(dir, name, &f)) < 0) {
+		if ((r = dir_lookup(dir, name, &f, &slot)) < 0) {
 			if (r == -E_NOT_FOUND && *path == '\0') {
 				if (pdir)
 					*pdir = dir;
@@ -341,25 +564,44 @@ walk_path(const char *path, struct File **pdir, struct File **pf, char *lastelem
 // File operations
 // --------------------------------------------------------------
 
-// Create "path".  On success set *pf to point at the file and return 0.
+// Create "path", of type 'type' (FTYPE_REG or FTYPE_DIR).  A new
+// directory is indexed if its parent is.
+// On success set *pf to point at the file and return 0.
 // On error return < 0.
 int
-file_create(const char *path, struct File **pf)
+file_create(const char *path, int type, struct File **pf)
 {
 	char name[MAXNAMELEN];
 	int r;
+	uint32_t slot;
 	struct File *dir, *f;
 
 	if ((r = walk_path(path, &dir, &f, name)) == 0)
 		return -E_FILE_EXISTS;
 	if (r != -E_NOT_FOUND || dir == 0)
 		return r;
-	if ((r = dir_alloc_file(dir, &f)) < 0)
+	if ((r = dir_alloc_file(dir, &f, &slot)) < 0)
 		return r;
 
+	memset(f, 0, sizeof(*f));
 	strcpy(f->f_name, name);
+	f->f_type = type;
+	if (super->s_features & FS_FEAT_EXTENTS)
+		f->f_flags = FILE_EXTENTS;
+	if (type == FTYPE_DIR && dir->f_dirindex
+	    && (r = dirindex_create(f)) < 0) {
+		f->f_name[0] = '\0';
+		return r;
+	}
+	if (dir->f_dirindex && (r = dirindex_insert(dir, name, slot)) < 0) {
+		dirindex_remove(dir, name, slot);
+		if (f->f_dirindex)
+			dirindex_free(f);
+		f->f_name[0] = '\0';
+		return r;
+	}
+	dcache_enter(dir, name, f, slot);
 	*pf = f;
-	file_flush(dir);
 	return 0;
 }
 
@@ -371,15 +613,58 @@ file_open(const char *path, struct File **pf)
 	return walk_path(path, 0, pf, 0);
 }
 
+// Get ready for a read of count bytes from f at offset.  A read that
+// starts where the last one through 'ra' stopped is sequential: it
+// grows the read-ahead window, doubling it from RA_MIN up to ra_max
+// blocks, while any other read drops it.  The blocks the read needs
+// and the window after them are brought into the block cache with as
+// few disk commands as their layout on disk allows.
+void
+file_readahead(struct File *f, struct Readahead *ra, off_t offset, size_t count)
+{
+	uint32_t bno, first, end, run = 0, runlen = 0, diskbno;
+
+	if (offset >= f->f_size || count == 0)
+		return;
+	count = MIN(count, f->f_size - offset);
+	first = offset / BLKSIZE;
+	end = ROUNDUP(offset + count, BLKSIZE) / BLKSIZE;
+
+	if (first == ra->ra_next || first + 1 == ra->ra_next)
+		ra->ra_window = ra->ra_window ? MIN(ra->ra_window * 2, ra_max)
+					      : MIN(RA_MIN, ra_max);
+	else
+		ra->ra_window = 0;
+	ra->ra_next = end;
+
+	end = MIN(end + ra->ra_window, ROUNDUP(f->f_size, BLKSIZE) / BLKSIZE);
+	for (bno = first; bno < end; bno++) {
+		if (file_map_block(f, bno, &diskbno) < 0)
+			diskbno = 0;
+		if (diskbno && runlen && diskbno == run + runlen) {
+			runlen++;
+			continue;
+		}
+		if (runlen)
+			bc_prefetch(run, runlen);
+		run = diskbno;
+		runlen = diskbno != 0;
+	}
+	if (runlen)
+		bc_prefetch(run, runlen);
+}
+
 // Read count bytes from f into buf, starting from seek position
 // offset.  This meant to mimic the standard pread function.
+// Blocks that were never written (holes) read as zeros and are not
+// allocated.
 // Returns the number of bytes read, < 0 on error.
 ssize_t
 file_read(struct File *f, void *buf, size_t count, off_t offset)
 {
 	int r, bn;
 	off_t pos;
-	char *blk;
+	uint32_t diskbno;
 
 	if (offset >= f->f_size)
 		return 0;
@@ -387,10 +672,13 @@ file_read(struct File *f, void *buf, size_t count, off_t offset)
 	count = MIN(count, f->f_size - offset);
 
 	for (pos = offset; pos < offset + count; ) {
-		if ((r = file_get_block(f, pos / BLKSIZE, &blk)) < 0)
+		if ((r = file_map_block(f, pos / BLKSIZE, &diskbno)) < 0)
 			return r;
 		bn = MIN(BLKSIZE - pos % BLKSIZE, offset + count - pos);
-		memmove(buf, blk + pos % BLKSIZE, bn);
+		if (diskbno)
+			memmove(buf, (char *) diskaddr(diskbno) + pos % BLKSIZE, bn);
+		else
+			memset(buf, 0, bn);
 		pos += bn;
 		buf += bn;
 	}
@@ -415,6 +703,12 @@ file_write(struct File *f, const void *buf, size_t count, off_t offset)
 		if ((r = file_set_size(f, offset + count)) < 0)
 			return r;
 
+	// Allocate the blocks being written together, so that they
+	// end up contiguous on disk.
+	if (count > 0 && (r = file_alloc_blocks(f, offset / BLKSIZE,
+			ROUNDUP(offset + count, BLKSIZE) / BLKSIZE - offset / BLKSIZE)) < 0)
+		return r;
+
 	for (pos = offset; pos < offset + count; ) {
 		if ((r = file_get_block(f, pos / BLKSIZE, &blk)) < 0)
 			return r;
@@ -461,6 +755,10 @@ file_truncate_blocks(struct File *f, off_t newsize)
 
 	old_nblocks = (f->f_size + BLKSIZE - 1) / BLKSIZE;
 	new_nblocks = (newsize + BLKSIZE - 1) / BLKSIZE;
+	if (f->f_flags & FILE_EXTENTS) {
+		ext_truncate(f, new_nblocks);
+		return;
+	}
 	for (bno = new_nblocks; bno < old_nblocks; bno++)
 		if ((r = file_free_block(f, bno)) < 0)
 			cprintf("warning: file_free_block: %e", r);
@@ -478,38 +776,96 @@ file_set_size(struct File *f, off_t newsize)
 	if (f->f_size > newsize)
 		file_truncate_blocks(f, newsize);
 	f->f_size = newsize;
-	flush_block(f);
 	return 0;
 }
 
-// Flush the contents and metadata of file f out to disk.
-// Loop over all the blocks in file.
-// Translate the file block number into a disk block number
-// and then check whether that disk block is dirty.  If so, write it out.
-void
-file_flush(struct File *f)
+// Remove a file, freeing its blocks.  A directory must be empty.
+int
+file_remove(const char *path)
+{
+	int r;
+	uint32_t slot, i, j, nblock;
+	char *blk;
+	struct File *dir, *f, *ent;
+
+	if ((r = walk_path(path, &dir, &f, 0)) < 0)
+		return r;
+	if (dir == 0)
+		return -E_INVAL;	// the root
+	if ((r = dir_lookup(dir, f->f_name, &f, &slot)) < 0)
+		return r;
+
+	if (f->f_type == FTYPE_DIR) {
+		nblock = f->f_size / BLKSIZE;
+		for (i = 0; i < nblock; i++) {
+			if ((r = file_get_block(f, i, &blk)) < 0)
+				return r;
+			ent = (struct File*) blk;
+			for (j = 0; j < BLKFILES; j++)
+				if (ent[j].f_name[0] != '\0')
+					return -E_INVAL;
+		}
+		if (f->f_dirindex)
+			dirindex_free(f);
+		dcache_purge(f);
+	}
+
+	dcache_enter(dir, f->f_name, NULL, 0);
+	if (dir->f_dirindex)
+		dirindex_remove(dir, f->f_name, slot);
+	file_truncate_blocks(f, 0);
+	memset(f, 0, sizeof(*f));
+	return 0;
+}
+
+// Write out the dirty blocks of f, which is mapped with block
+// pointers, each run of blocks that are adjacent on disk with one
+// command.
+static void
+file_flush_blocks(struct File *f)
 {
 	int i;
-	uint32_t *pdiskbno;
+	uint32_t *pdiskbno, run = 0, runlen = 0;
 
 	for (i = 0; i < (f->f_size + BLKSIZE - 1) / BLKSIZE; i++) {
 		if (file_block_walk(f, i, &pdiskbno, 0) < 0 ||
 		    pdiskbno == NULL || *pdiskbno == 0)
 			continue;
-		flush_block(diskaddr(*pdiskbno));
+		if (runlen && *pdiskbno == run + runlen) {
+			runlen++;
+			continue;
+		}
+		if (runlen)
+			bc_flush_range(run, runlen);
+		run = *pdiskbno;
+		runlen = 1;
 	}
-	flush_block(f);
+	if (runlen)
+		bc_flush_range(run, runlen);
 	if (f->f_indirect)
 		flush_block(diskaddr(f->f_indirect));
 }
 
+// Flush the contents and metadata of file f out to disk.
+// Translate the file block numbers into disk block numbers
+// and write out the dirty ones.  The bitmap is written too,
+// since allocations are not flushed when they are made.
+void
+file_flush(struct File *f)
+{
+	if (f->f_flags & FILE_EXTENTS)
+		ext_flush(f);
+	else
+		file_flush_blocks(f);
+	flush_block(f);
+	bc_flush_range(2, (super->s_nblocks + BLKBITSIZE - 1) / BLKBITSIZE);
+}
+
 
 // Sync the entire file system.  A big hammer.
 void
 fs_sync(void)
 {
-	int i;
-	for (i = 1; i < super->s_nblocks; i++)
-		flush_block(diskaddr(i));
+	bc_sync();
 }
 
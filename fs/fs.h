@@ -11,7 +11,48 @@
 /* Maximum disk size we can handle (3GB) */
 #define DISKSIZE	0xC0000000
 
+/* Most blocks the block cache can be set to hold, and the default.
+ * The superblock and bitmap blocks are cached on top of these. */
+#define BC_MAXBLOCKS		4096
+#define BC_DEFAULT_BLOCKS	512
+
+/* Entries in the list of dirty blocks: all cached blocks and then some,
+ * so that the list is rarely compacted. */
+#define BC_DIRTYMAX		(2 * BC_MAXBLOCKS)
+
+/* Most blocks read with one disk command (256 sectors). */
+#define BC_CLUSTER		(256 / BLKSECTS)
+
+/* Where bc_read reads blocks before mapping them into the disk map. */
+#define BC_STAGE		(DISKMAP - BC_CLUSTER * BLKSIZE)
+
+/* Requests the server works on at once, each on its own thread. */
+#define FS_NTHREADS		8
+
+/* How long a block may stay dirty before the server writes it back. */
+#define BC_FLUSH_NSEC		NSEC_PER_SEC
+
+/* Read-ahead window bounds, in blocks. */
+#define RA_MIN			4
+#define RA_MAX			BC_CLUSTER
+
+/* Read-ahead state of an open file. */
+struct Readahead {
+	uint32_t ra_next;	/* File block a sequential read starts in */
+	uint32_t ra_window;	/* Blocks to read ahead; 0 if not sequential */
+};
+
+/* A lock held by file server threads (see thread.c).  It is held
+ * either exclusively by one thread or shared by any number. */
+struct tlock {
+	struct Thread *l_owner;	/* Exclusive holder, or NULL */
+	int l_depth;		/* Times l_owner has locked it */
+	int l_shared;		/* Shared holders */
+	int l_waiting;		/* Threads waiting to hold it exclusively */
+};
+
 struct Super *super;		// superblock
+uint32_t ra_max;		// Largest read-ahead window, in blocks
 uint32_t *bitmap;		// bitmap blocks mapped in memory
 
 /* ide.c */
@@ -21,28 +62,70 @@ void	ide_set_partition(uint32_t first_sect, uint32_t nsect);
 int	ide_read(uint32_t secno, void *dst, size_t nsecs);
 int	ide_write(uint32_t secno, const void *src, size_t nsecs);
 
+/* thread.c */
+struct Thread *thread_create(void (*fn)(void *), void *arg);
+void	thread_run(struct Thread *t);
+void	thread_yield(void);
+void	tlock_lock(struct tlock *l);
+void	tlock_lock_shared(struct tlock *l);
+void	tlock_unlock(struct tlock *l);
+
 /* bc.c */
 void*	diskaddr(uint32_t blockno);
 bool	va_is_mapped(void *va);
 bool	va_is_dirty(void *va);
 void	flush_block(void *addr);
 void	bc_init(void);
+void	bc_prefetch(uint32_t blockno, uint32_t n);
+void	bc_flush_range(uint32_t blockno, uint32_t n);
+void	bc_sync(void);
+int	bc_dirty_count(void);
+int	bc_set_limit(int limit);
+void	bc_get_stat(struct BcStat *st);
 
 /* fs.c */
 void	fs_init(void);
 int	file_get_block(struct File *f, uint32_t file_blockno, char **pblk);
-int	file_create(const char *path, struct File **f);
+int	file_create(const char *path, int type, struct File **f);
 int	file_open(const char *path, struct File **f);
 ssize_t	file_read(struct File *f, void *buf, size_t count, off_t offset);
+void	file_readahead(struct File *f, struct Readahead *ra, off_t offset, size_t count);
 int	file_write(struct File *f, const void *buf, size_t count, off_t offset);
 int	file_set_size(struct File *f, off_t newsize);
 void	file_flush(struct File *f);
 int	file_remove(const char *path);
 void	fs_sync(void);
 
+int	file_map_block(struct File *f, uint32_t filebno, uint32_t *diskbno);
+
+/* extent.c */
+void	ext_lookup(struct File *f, uint32_t filebno, uint32_t *diskbno);
+int	ext_insert(struct File *f, uint32_t filebno, uint32_t diskbno);
+void	ext_truncate(struct File *f, uint32_t nblocks);
+void	ext_flush(struct File *f);
+
+/* dirindex.c */
+int	dirindex_lookup(struct File *dir, const char *name, struct File **file,
+			uint32_t *slot);
+int	dirindex_insert(struct File *dir, const char *name, uint32_t slot);
+void	dirindex_remove(struct File *dir, const char *name, uint32_t slot);
+int	dirindex_create(struct File *dir);
+void	dirindex_free(struct File *dir);
+
+/* dcache.c */
+int	dcache_lookup(struct File *dir, const char *name, struct File **file,
+		      uint32_t *slot);
+void	dcache_enter(struct File *dir, const char *name, struct File *file,
+		     uint32_t slot);
+void	dcache_purge(struct File *dir);
+void	dcache_get_stat(struct BcStat *st);
+
 /* int	map_block(uint32_t); */
 bool	block_is_free(uint32_t blockno);
 int	alloc_block(void);
+int	alloc_block_run(uint32_t goal, uint32_t want, uint32_t *got);
+void	free_block(uint32_t blockno);
+uint32_t free_block_count(void);
 
 /* test.c */
 void	fs_test(void);
@@ -42,6 +42,7 @@ struct Dir
 };
 
 uint32_t nblocks;
+int blockptrs;		// Write the old block-pointer format
 char *diskmap, *diskpos;
 struct Super *super;
 uint32_t *bitmap;
@@ -111,6 +112,7 @@ opendisk(const char *name)
 	super = alloc(BLKSIZE);
 	super->s_magic = FS_MAGIC;
 	super->s_nblocks = nblocks;
+	super->s_features = blockptrs ? 0 : FS_FEAT_EXTENTS;
 	super->s_root.f_type = FTYPE_DIR;
 	strcpy(super->s_root.f_name, "/");
 
@@ -137,6 +139,17 @@ finishfile(struct File *f, uint32_t start, uint32_t len)
 	int i;
 	f->f_size = len;
 	len = ROUNDUP(len, BLKSIZE);
+	if (!blockptrs) {
+		// Files are written contiguously: one extent will do.
+		f->f_flags = FILE_EXTENTS;
+		if (len > 0) {
+			f->f_nextents = 1;
+			f->f_extent[0].e_lblk = 0;
+			f->f_extent[0].e_pblk = start;
+			f->f_extent[0].e_len = len / BLKSIZE;
+		}
+		return;
+	}
 	for (i = 0; i < len / BLKSIZE && i < NDIRECT; ++i)
 		f->f_direct[i] = start + i;
 	if (i == NDIRECT) {
@@ -169,10 +182,28 @@ diradd(struct Dir *d, uint32_t type, const char *name)
 void
 finishdir(struct Dir *d)
 {
-	int size = d->n * sizeof(struct File);
+	int size = d->n * sizeof(struct File), i;
 	struct File *start = alloc(size);
+	struct DirIndex *di;
+	struct DirLeaf *dl;
+
 	memmove(start, d->ents, size);
 	finishfile(d->f, blockof(start), ROUNDUP(size, BLKSIZE));
+
+	// Index the names.  MAX_DIR_ENTS fit in a single leaf.
+	if (!blockptrs) {
+		di = alloc(BLKSIZE);
+		dl = alloc(BLKSIZE);
+		di->di_depth = 0;
+		di->di_freehint = d->n;
+		di->di_leaf[0] = blockof(dl);
+		for (i = 0; i < d->n; i++) {
+			dl->dl_ent[i].de_hash = dirhash(d->ents[i].f_name);
+			dl->dl_ent[i].de_slot = i;
+		}
+		dl->dl_count = d->n;
+		d->f->f_dirindex = blockof(di);
+	}
 	free(d->ents);
 	d->ents = NULL;
 }
@@ -192,7 +223,7 @@ writefile(struct Dir *dir, const char *name)
 		panic("stat %s: %s", name, strerror(errno));
 	if (!S_ISREG(st.st_mode))
 		panic("%s is not a regular file", name);
-	if (st.st_size >= MAXFILESIZE)
+	if (blockptrs && st.st_size >= MAXFILESIZE)
 		panic("%s too large", name);
 
 	last = strrchr(name, '/');
@@ -211,7 +242,8 @@ writefile(struct Dir *dir, const char *name)
 void
 usage(void)
 {
-	fprintf(stderr, "Usage: fsformat fs.img NBLOCKS files...\n");
+	fprintf(stderr, "Usage: fsformat [-b] fs.img NBLOCKS files...\n"
+		"  -b  map files with block pointers, not extents\n");
 	exit(2);
 }
 
@@ -223,7 +255,15 @@ main(int argc, char **argv)
 	struct Dir root;
 
 	assert(BLKSIZE % sizeof(struct File) == 0);
-
+	assert(sizeof(struct File) == 256);
+	assert(sizeof(struct ExtentBlock) <= BLKSIZE);
+	assert(MAX_DIR_ENTS <= NLEAFENTS);
+
+	if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+		blockptrs = 1;
+		argc--;
+		argv++;
+	}
 	if (argc < 3)
 		usage();
 	printf("!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!1\n");
@@ -19,8 +19,9 @@ ide_wait_ready(bool check_error)
 {
 	int r;
 
+	// Let the file server's other threads run while the disk is busy.
 	while (((r = inb(0x1F7)) & (IDE_BSY|IDE_DRDY)) != IDE_DRDY)
-		/* do nothing */;
+		thread_yield();
 
 	if (check_error && (r & (IDE_DF|IDE_ERR)) != 0)
 		return -1;
@@ -34,6 +34,9 @@ struct OpenFile {
 	struct File *o_file;	// mapped descriptor for open file
 	int o_mode;		// open mode
 	struct Fd *o_fd;	// Fd page
+	struct Readahead o_ra;	// Sequential read detection
+	struct tlock o_lock;	// Held while a read or write uses and
+				// advances the seek position
 };
 
 // Max number of open files in the file system at once
@@ -45,8 +48,52 @@ struct OpenFile opentab[MAXOPEN] = {
 	{ 0, 0, 1, 0 }
 };
 
-// Virtual address at which to receive page mappings containing client requests.
-union Fsipc *fsreq = (union Fsipc *)0x0ffff000;
+// The server works on up to FS_NTHREADS requests at once, each on a
+// worker thread (see thread.c).  A worker runs until its request is
+// done or it has to wait for the disk or a lock; then serve runs the
+// other workers and takes in new requests.
+//
+// Each worker receives its requests in a window of its own: the
+// request page, followed by room for the data pages of a range request.
+#define FSREQ_WINSIZE	((FSREQ_MAXPAGES + 1) * PGSIZE)
+#define FSREQ_WINDOWS	(BC_STAGE - FS_NTHREADS * FSREQ_WINSIZE)
+
+// How long a reply waits for its client to receive it.
+#define REPLY_NSEC	(NSEC_PER_SEC / 10)
+
+struct Worker {
+	struct Thread *w_thread;
+	union Fsipc *w_req;	// Receive window
+	uint32_t w_reqno;	// Request being served
+	envid_t w_whom;		// Its sender
+	int w_perm;		// Permissions of its pages
+	int w_npages;		// Number of pages it came with
+	bool w_busy;		// Serving a request, not done yet
+	bool w_replying;	// Done, but the reply is not sent yet
+	uint64_t w_reply_by;	// When to give up sending it
+	int w_r;		// Reply, once done
+	void *w_pg;
+	int w_pgperm;
+};
+
+static struct Worker workers[FS_NTHREADS];
+static int nbusy;		// Busy workers
+
+// Requests that change the file system hold fs_lock exclusively, and
+// all others hold it shared; the bitmap and the File structures only
+// change under the exclusive lock.  Opens also hold opentab_lock while
+// they pick and fill in an opentab entry, and reads and writes hold
+// their OpenFile's o_lock, since readers of one file can share fs_lock
+// but not its seek position.
+static struct tlock fs_lock;
+static struct tlock opentab_lock;
+
+// The worker whose window holds the request at 'req'.
+static struct Worker *
+req_worker(void *req)
+{
+	return &workers[((uintptr_t) req - FSREQ_WINDOWS) / FSREQ_WINSIZE];
+}
 
 void
 serve_init(void)
@@ -126,7 +173,8 @@ serve_open(envid_t envid, struct Fsreq_open *req,
 
 	// Open the file
 	if (req->req_omode & O_CREAT) {
-		if ((r = file_create(path, &f)) < 0) {
+		if ((r = file_create(path, (req->req_omode & O_MKDIR)
+				     ? FTYPE_DIR : FTYPE_REG, &f)) < 0) {
 			if (!(req->req_omode & O_EXCL) && r == -E_FILE_EXISTS)
 				goto try_open;
 			if (debug)
@@ -158,6 +206,7 @@ try_open:
 
 	// Save the file pointer
 	o->o_file = f;
+	memset(&o->o_ra, 0, sizeof(o->o_ra));
 
 	// Fill out the Fd structure
 	o->o_fd->fd_file.id = o->o_fileid;
@@ -219,10 +268,13 @@ serve_read(envid_t envid, union Fsipc *ipc)
 	r = openfile_lookup(envid, req->req_fileid, &of);
 	if( r < 0) return r;
 
+	tlock_lock(&of->o_lock);
+	file_readahead(of->o_file, &of->o_ra, of->o_fd->fd_offset,
+		       MIN(req->req_n, sizeof(ret->ret_buf)));
 	r = file_read(of->o_file, ret->ret_buf, req->req_n, of->o_fd->fd_offset);
-	if(r < 0) return r;
-
-	of->o_fd->fd_offset += r;
+	if (r >= 0)
+		of->o_fd->fd_offset += r;
+	tlock_unlock(&of->o_lock);
 	return r;
 }
 
@@ -246,9 +298,61 @@ serve_write(envid_t envid, struct Fsreq_write *req)
 
 	reqn = MIN(req->req_n, PGSIZE);
 
+	tlock_lock(&of->o_lock);
 	r = file_write(of->o_file, req->req_buf, reqn, of->o_fd->fd_offset);
-	if(r < 0) return r;
-	of->o_fd->fd_offset += r;
+	if (r >= 0)
+		of->o_fd->fd_offset += r;
+	tlock_unlock(&of->o_lock);
+	return r;
+}
+
+// Read up to req->req_n bytes from req_fileid into the data pages that
+// came with the request, starting at the current seek position, and
+// update the seek position.  Returns the number of bytes read, or < 0
+// on error.
+int
+serve_read_range(envid_t envid, struct Fsreq_range *req)
+{
+	struct OpenFile *o;
+	size_t n;
+	int r;
+
+	if (debug)
+		cprintf("serve_read_range %08x %08x %08x\n", envid, req->req_fileid, req->req_n);
+
+	if ((r = openfile_lookup(envid, req->req_fileid, &o)) < 0)
+		return r;
+	if (!(req_worker(req)->w_perm & PTE_W))
+		return -E_INVAL;
+	n = MIN(req->req_n, (req_worker(req)->w_npages - 1) * PGSIZE);
+	tlock_lock(&o->o_lock);
+	file_readahead(o->o_file, &o->o_ra, o->o_fd->fd_offset, n);
+	if ((r = file_read(o->o_file, (char *) req + PGSIZE, n, o->o_fd->fd_offset)) >= 0)
+		o->o_fd->fd_offset += r;
+	tlock_unlock(&o->o_lock);
+	return r;
+}
+
+// Write up to req->req_n bytes from the data pages that came with the
+// request to req_fileid, as serve_write does.  Returns the number of
+// bytes written, or < 0 on error.
+int
+serve_write_range(envid_t envid, struct Fsreq_range *req)
+{
+	struct OpenFile *o;
+	size_t n;
+	int r;
+
+	if (debug)
+		cprintf("serve_write_range %08x %08x %08x\n", envid, req->req_fileid, req->req_n);
+
+	if ((r = openfile_lookup(envid, req->req_fileid, &o)) < 0)
+		return r;
+	n = MIN(req->req_n, (req_worker(req)->w_npages - 1) * PGSIZE);
+	tlock_lock(&o->o_lock);
+	if ((r = file_write(o->o_file, (char *) req + PGSIZE, n, o->o_fd->fd_offset)) >= 0)
+		o->o_fd->fd_offset += r;
+	tlock_unlock(&o->o_lock);
 	return r;
 }
 
@@ -290,6 +394,21 @@ serve_flush(envid_t envid, struct Fsreq_flush *req)
 	return 0;
 }
 
+// Remove the file req->req_path.
+int
+serve_remove(envid_t envid, struct Fsreq_remove *req)
+{
+	char path[MAXPATHLEN];
+
+	if (debug)
+		cprintf("serve_remove %08x %s\n", envid, req->req_path);
+
+	// Copy in the path, making sure it's null-terminated
+	memmove(path, req->req_path, MAXPATHLEN);
+	path[MAXPATHLEN-1] = 0;
+
+	return file_remove(path);
+}
 
 int
 serve_sync(envid_t envid, union Fsipc *req)
@@ -298,6 +417,30 @@ serve_sync(envid_t envid, union Fsipc *req)
 	return 0;
 }
 
+// Report the block cache counters, first setting the cache size to
+// req_limit blocks if that is nonzero and the largest read-ahead
+// window to req_ramax blocks if that is not negative.
+int
+serve_bcstat(envid_t envid, struct Fsreq_bcstat *req)
+{
+	bc_set_limit(req->req_limit);
+	if (req->req_ramax >= 0)
+		ra_max = MIN(req->req_ramax, RA_MAX);
+	bc_get_stat(&((union Fsipc *) req)->bcstatRet);
+	((union Fsipc *) req)->bcstatRet.bs_ramax = ra_max;
+	dcache_get_stat(&((union Fsipc *) req)->bcstatRet);
+	return 0;
+}
+
+// Report the size of the disk and how much of it is free.
+int
+serve_statfs(envid_t envid, union Fsipc *ipc)
+{
+	ipc->statfsRet.sf_nblocks = super->s_nblocks;
+	ipc->statfsRet.sf_nfree = free_block_count();
+	return 0;
+}
+
 typedef int (*fshandler)(envid_t envid, union Fsipc *req);
 
 fshandler handlers[] = {
@@ -306,43 +449,245 @@ fshandler handlers[] = {
 	[FSREQ_READ] =		serve_read,
 	[FSREQ_STAT] =		serve_stat,
 	[FSREQ_FLUSH] =		(fshandler)serve_flush,
+	[FSREQ_REMOVE] =	(fshandler)serve_remove,
 	[FSREQ_WRITE] =		(fshandler)serve_write,
 	[FSREQ_SET_SIZE] =	(fshandler)serve_set_size,
-	[FSREQ_SYNC] =		serve_sync
+	[FSREQ_SYNC] =		serve_sync,
+	[FSREQ_READ_RANGE] =	(fshandler)serve_read_range,
+	[FSREQ_WRITE_RANGE] =	(fshandler)serve_write_range,
+	[FSREQ_BCSTAT] =	(fshandler)serve_bcstat,
+	[FSREQ_STATFS] =	serve_statfs
 };
 
-void
-serve(void)
+// Dirty blocks are written back in the background: at most
+// BC_FLUSH_NSEC after the last write-back while requests keep coming,
+// or once the server has been idle that long.
+static uint64_t last_writeback;
+
+static void
+serve_writeback(void)
 {
-	uint32_t req, whom;
-	int perm, r;
-	void *pg;
+	fs_sync();
+	last_writeback = time_nsec();
+}
+
+// Does request 'req' change the file system?
+static bool
+req_modifies(uint32_t req, union Fsipc *ipc)
+{
+	switch (req) {
+	case FSREQ_OPEN:
+		return ipc->open.req_omode & (O_CREAT|O_TRUNC);
+	case FSREQ_SET_SIZE:
+	case FSREQ_WRITE:
+	case FSREQ_REMOVE:
+	case FSREQ_WRITE_RANGE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Serve requests given to worker 'arg' by serve, forever.
+static void
+serve_worker(void *arg)
+{
+	struct Worker *w = arg;
+	uint32_t req;
+	int r;
 
 	while (1) {
-		perm = 0;
-		req = ipc_recv((int32_t *) &whom, fsreq, &perm);
+		req = w->w_reqno;
 		if (debug)
 			cprintf("fs req %d from %08x [page %08x: %s]\n",
-				req, whom, uvpt[PGNUM(fsreq)], fsreq);
-
-		// All requests must contain an argument page
-		if (!(perm & PTE_P)) {
-			cprintf("Invalid request from %08x: no argument page\n",
-				whom);
-			continue; // just leave it hanging...
-		}
+				req, w->w_whom, uvpt[PGNUM(w->w_req)], w->w_req);
 
-		pg = NULL;
+		if (req_modifies(req, w->w_req))
+			tlock_lock(&fs_lock);
+		else
+			tlock_lock_shared(&fs_lock);
+		w->w_pg = NULL;
 		if (req == FSREQ_OPEN) {
-			r = serve_open(whom, (struct Fsreq_open*)fsreq, &pg, &perm);
+			tlock_lock(&opentab_lock);
+			w->w_r = serve_open(w->w_whom, &w->w_req->open,
+					    &w->w_pg, &w->w_pgperm);
+			tlock_unlock(&opentab_lock);
 		} else if (req < ARRAY_SIZE(handlers) && handlers[req]) {
-			r = handlers[req](whom, fsreq);
+			w->w_r = handlers[req](w->w_whom, w->w_req);
 		} else {
-			cprintf("Invalid request code %d from %08x\n", req, whom);
-			r = -E_INVAL;
+			cprintf("Invalid request code %d from %08x\n",
+				req, w->w_whom);
+			w->w_r = -E_INVAL;
 		}
-		ipc_send(whom, r, pg, perm);
-		sys_page_unmap(0, fsreq);
+		tlock_unlock(&fs_lock);
+
+		// Let go of the client's pages: a later request may bring
+		// fewer, and must not leave us holding the rest.  The reply
+		// never comes from the window, so this need not wait for it.
+		if ((r = sys_page_unmap_range(0, w->w_req,
+					      w->w_npages * PGSIZE)) < 0)
+			panic("serve_worker: unmap request: %e", r);
+
+		w->w_busy = false;
+		w->w_replying = true;
+		w->w_reply_by = time_nsec() + REPLY_NSEC;
+		nbusy--;
+		thread_yield();
+	}
+}
+
+// Hand the request just received into w's window to w.
+static void
+serve_start(struct Worker *w, uint32_t req, envid_t whom, int perm)
+{
+	// All requests must contain an argument page
+	if (!(perm & PTE_P)) {
+		cprintf("Invalid request from %08x: no argument page\n", whom);
+		// just leave it hanging...
+		return;
+	}
+	w->w_reqno = req;
+	w->w_whom = whom;
+	w->w_perm = perm;
+	w->w_npages = thisenv->env_ipc_npages;
+	w->w_busy = true;
+	nbusy++;
+}
+
+// Send the reply of the finished worker w if its client is receiving.
+// A client that is not, because it sent its request with plain
+// ipc_send and has not got to ipc_recv yet or because it gave up
+// waiting, is tried again later until REPLY_NSEC has passed.  A client
+// that has gone away gets no reply.  Either way the server never
+// blocks on a client.
+static void
+serve_reply(struct Worker *w)
+{
+	void *pg = w->w_pg ? w->w_pg : (void *) ~0;
+
+	if (sys_ipc_try_send(w->w_whom, w->w_r, pg, w->w_pgperm) != -E_IPC_NOT_RECV
+	    || time_nsec() >= w->w_reply_by)
+		w->w_replying = false;
+}
+
+// Run each busy worker until it finishes its request or has to wait,
+// and reply to the ones that finish.  If that leaves no request in
+// progress, the last reply is not sent but returned, so that it can
+// go out with the next receive.
+static struct Worker *
+serve_run(void)
+{
+	struct Worker *w, *last = NULL;
+
+	for (w = workers; w < workers + FS_NTHREADS; w++) {
+		if (!w->w_busy)
+			continue;
+		thread_run(w->w_thread);
+		if (w->w_busy)
+			continue;
+		if (last)
+			serve_reply(last);
+		last = w;
+	}
+	if (last && nbusy > 0) {
+		serve_reply(last);
+		last = NULL;
+	}
+	return last;
+}
+
+// Return a worker free to take a new request, or NULL if there is none.
+static struct Worker *
+serve_free_worker(void)
+{
+	struct Worker *w;
+
+	for (w = workers; w < workers + FS_NTHREADS; w++)
+		if (!w->w_busy && !w->w_replying)
+			return w;
+	return NULL;
+}
+
+// Is a request waiting for us to receive it?
+static bool
+request_pending(void)
+{
+	return thisenv->env_ipc_senders.wq_head != NULL;
+}
+
+void
+serve(void)
+{
+	struct Worker *w, *done;
+	uint32_t req, whom;
+	int i, perm, nreplying;
+
+	for (i = 0; i < FS_NTHREADS; i++) {
+		workers[i].w_req = (union Fsipc *) (FSREQ_WINDOWS + i * FSREQ_WINSIZE);
+		workers[i].w_thread = thread_create(serve_worker, &workers[i]);
+	}
+
+	last_writeback = time_nsec();
+	done = NULL;
+	while (1) {
+		// Write back only while no request is in progress: the
+		// main thread keeps off the disk map while workers are busy.
+		if (nbusy == 0) {
+			if (bc_dirty_count() == 0)
+				last_writeback = time_nsec();
+			else if (time_nsec() - last_writeback >= BC_FLUSH_NSEC)
+				serve_writeback();
+		}
+
+		// Try again to send the replies clients were not taking.
+		nreplying = 0;
+		for (w = workers; w < workers + FS_NTHREADS; w++)
+			if (w->w_replying && w != done) {
+				serve_reply(w);
+				nreplying += w->w_replying;
+			}
+
+		// Receive into the window of a free worker, or else of
+		// done, whose reply goes out first.
+		if (!(w = serve_free_worker()) && !(w = done)) {
+			// Every worker holds a reply; wait a clock tick.
+			sys_sleep(1);
+			continue;
+		}
+
+		// Arm the timeout right before the receive it is meant for.
+		// With requests in progress or replies to retry, come back
+		// at the next clock tick at the latest; when idle, when the
+		// dirty blocks are due to be written back.
+		if (nbusy > 0 || nreplying > 0)
+			sys_set_timeout(0);
+		else if (bc_dirty_count())
+			sys_set_timeout(BC_FLUSH_NSEC);
+
+		// Reply and wait for the next request in one system call,
+		// or just wait if there is no reply to send.  The reply
+		// fails, and we do not wait, if done's client is not
+		// receiving; it is then retried above.
+		perm = 0;
+		if (done) {
+			req = ipc_reply_wait(done->w_whom, done->w_r, done->w_pg,
+					     done->w_pgperm
+					     | IPC_RECVPAGES(FSREQ_MAXPAGES + 1),
+					     w->w_req, (envid_t *) &whom, &perm);
+			if ((int32_t) req != -E_IPC_NOT_RECV)
+				done->w_replying = false;
+		} else
+			req = ipc_reply_wait(0, 0, NULL,
+					     IPC_RECVPAGES(FSREQ_MAXPAGES + 1),
+					     w->w_req, (envid_t *) &whom, &perm);
+		if ((int32_t) req >= 0)
+			serve_start(w, req, whom, perm);
+
+		// Run the workers until all are done, or a new request is
+		// waiting and there is a worker free to take it.
+		done = NULL;
+		while (nbusy > 0 && !(serve_free_worker() && request_pending()))
+			done = serve_run();
 	}
 }
 
@@ -359,7 +704,9 @@ umain(int argc, char **argv)
 
 	serve_init();
 	fs_init();
-        fs_test();
+#ifndef JOS_RELEASE
+	fs_test();
+#endif
 	serve();
 }
 
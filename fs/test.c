@@ -8,10 +8,10 @@ static char *msg = "This is the NEW message of the day!\n\n";
 void
 fs_test(void)
 {
-	struct File *f;
+	struct File *f, *g;
 	int r;
 	char *blk;
-	uint32_t *bits;
+	uint32_t *bits, i, got, nfree, diskbno;
 
 	// back up bitmap
 	if ((r = sys_page_alloc(0, (void*) PGSIZE, PTE_P|PTE_U|PTE_W)) < 0)
@@ -27,6 +27,19 @@ fs_test(void)
 	assert(!(bitmap[r/32] & (1 << (r%32))));
 	cprintf("alloc_block is good\n");
 
+	// allocate a run of blocks and give them back
+	nfree = free_block_count();
+	if ((r = alloc_block_run(0, 4, &got)) < 0)
+		panic("alloc_block_run: %e", r);
+	assert(got >= 1 && got <= 4);
+	assert(free_block_count() == nfree - got);
+	for (i = 0; i < got; i++) {
+		assert(!block_is_free(r + i));
+		free_block(r + i);
+	}
+	assert(free_block_count() == nfree);
+	cprintf("alloc_block_run is good\n");
+
 	if ((r = file_open("/not-found", &f)) < 0 && r != -E_NOT_FOUND)
 		panic("file_open /not-found: %e", r);
 	else if (r == 0)
@@ -49,13 +62,14 @@ fs_test(void)
 
 	if ((r = file_set_size(f, 0)) < 0)
 		panic("file_set_size: %e", r);
-	assert(f->f_direct[0] == 0);
-	assert(!(uvpt[PGNUM(f)] & PTE_D));
+	assert(file_map_block(f, 0, &diskbno) == 0 && diskbno == 0);
+	// The new size is written back later.
+	assert((uvpt[PGNUM(f)] & PTE_D));
 	cprintf("file_truncate is good\n");
 
 	if ((r = file_set_size(f, strlen(msg))) < 0)
 		panic("file_set_size 2: %e", r);
-	assert(!(uvpt[PGNUM(f)] & PTE_D));
+	assert((uvpt[PGNUM(f)] & PTE_D));
 	if ((r = file_get_block(f, 0, &blk)) < 0)
 		panic("file_get_block 2: %e", r);
 	strcpy(blk, msg);
@@ -63,5 +77,49 @@ fs_test(void)
 	file_flush(f);
 	assert(!(uvpt[PGNUM(blk)] & PTE_D));
 	assert(!(uvpt[PGNUM(f)] & PTE_D));
+	assert(!(f->f_flags & FILE_EXTENTS) || f->f_nextents == 1);
 	cprintf("file rewrite is good\n");
+
+	// A hole reads as zeros and takes no disk space.
+	nfree = free_block_count();
+	if ((r = file_set_size(f, 10 * BLKSIZE)) < 0)
+		panic("file_set_size 3: %e", r);
+	memset(bits, 0xFF, BLKSIZE);
+	if ((r = file_read(f, bits, BLKSIZE, 5 * BLKSIZE)) != BLKSIZE)
+		panic("file_read hole: %e", r);
+	for (i = 0; i < BLKSIZE / 4; i++)
+		assert(bits[i] == 0);
+	assert(free_block_count() == nfree);
+	assert(file_map_block(f, 5, &diskbno) == 0 && diskbno == 0);
+	if ((r = file_set_size(f, strlen(msg))) < 0)
+		panic("file_set_size 4: %e", r);
+	cprintf("file hole is good\n");
+
+	if ((r = file_create("/dirtest", FTYPE_REG, &f)) < 0)
+		panic("file_create /dirtest: %e", r);
+	if ((r = file_open("/dirtest", &g)) < 0)
+		panic("file_open /dirtest: %e", r);
+	assert(f == g);
+	if ((r = file_remove("/dirtest")) < 0)
+		panic("file_remove /dirtest: %e", r);
+	if ((r = file_open("/dirtest", &g)) != -E_NOT_FOUND)
+		panic("file_open removed /dirtest: %e", r);
+	cprintf("file_remove is good\n");
+
+	if ((r = file_create("/dirtest", FTYPE_DIR, &f)) < 0)
+		panic("file_create dir /dirtest: %e", r);
+	assert(f->f_type == FTYPE_DIR);
+	assert(!f->f_dirindex == !super->s_root.f_dirindex);
+	if ((r = file_create("/dirtest/f", FTYPE_REG, &g)) < 0)
+		panic("file_create /dirtest/f: %e", r);
+	if ((r = file_open("/dirtest/f", &f)) < 0)
+		panic("file_open /dirtest/f: %e", r);
+	assert(f == g);
+	if ((r = file_remove("/dirtest")) != -E_INVAL)
+		panic("file_remove nonempty /dirtest: %e", r);
+	if ((r = file_remove("/dirtest/f")) < 0)
+		panic("file_remove /dirtest/f: %e", r);
+	if ((r = file_remove("/dirtest")) < 0)
+		panic("file_remove dir /dirtest: %e", r);
+	cprintf("file_create directory is good\n");
 }
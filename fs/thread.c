@@ -0,0 +1,174 @@
+/*
+ * File server threads.
+ *
+ * The server works on up to FS_NTHREADS requests at once, each on a
+ * thread of its own.  Threads are cooperative: the main thread (the
+ * serve loop) runs a thread with thread_run, and the thread keeps the
+ * CPU until it calls thread_yield, which it does only while waiting
+ * for the disk or for a tlock.  Code between two such waits runs
+ * without interference, so a lock is needed only around state that
+ * must stay consistent across a wait.
+ *
+ * A thread may wait in the middle of a block cache page fault, with
+ * its fault frame on the exception stack.  So every thread has an
+ * exception stack page of its own, and thread_run maps it at
+ * UXSTACKTOP before running the thread.  The main thread has none:
+ * it only touches the disk map while no other thread is busy, so it
+ * can use whichever page is there.
+ */
+
+#include "fs.h"
+
+#define THREAD_STACKSIZE	(4 * PGSIZE)
+
+struct Thread {
+	uint32_t t_esp;			// Saved stack pointer
+	void (*t_fn)(void *);		// Function the thread runs
+	void *t_arg;
+	void *t_uxstack;		// Exception stack page
+};
+
+// threads[0] is the main thread.
+static struct Thread threads[FS_NTHREADS + 1];
+static int nthreads = 1;
+static struct Thread *curthread = &threads[0];
+static struct Thread *uxstack_owner;	// Whose exception stack is mapped
+
+static uint8_t thread_stack[FS_NTHREADS][THREAD_STACKSIZE]
+	__attribute__((aligned(PGSIZE)));
+static uint8_t thread_uxstack[FS_NTHREADS][PGSIZE]
+	__attribute__((aligned(PGSIZE)));
+
+// Save the callee-saved registers and the stack pointer in *save_esp,
+// then switch to the stack at 'esp' and return to whatever saved it.
+void thread_switch(uint32_t *save_esp, uint32_t esp);
+asm(".text\n"
+    ".globl thread_switch\n"
+    "thread_switch:\n"
+    "	movl 4(%esp), %eax\n"
+    "	movl 8(%esp), %edx\n"
+    "	pushl %ebp\n"
+    "	pushl %ebx\n"
+    "	pushl %esi\n"
+    "	pushl %edi\n"
+    "	movl %esp, (%eax)\n"
+    "	movl %edx, %esp\n"
+    "	popl %edi\n"
+    "	popl %esi\n"
+    "	popl %ebx\n"
+    "	popl %ebp\n"
+    "	ret\n");
+
+// Where a new thread starts, on the first thread_switch to it.
+static void
+thread_start(void)
+{
+	curthread->t_fn(curthread->t_arg);
+	panic("file server thread returned");
+}
+
+// Create a thread that runs fn(arg).  It first runs when it is passed
+// to thread_run.
+struct Thread *
+thread_create(void (*fn)(void *), void *arg)
+{
+	struct Thread *t;
+	uint32_t *sp;
+
+	if (nthreads > FS_NTHREADS)
+		panic("thread_create: too many threads");
+	t = &threads[nthreads];
+	t->t_fn = fn;
+	t->t_arg = arg;
+	t->t_uxstack = thread_uxstack[nthreads - 1];
+
+	// A frame for thread_switch to pop: four registers, then its
+	// return address.
+	sp = (uint32_t *) (thread_stack[nthreads - 1] + THREAD_STACKSIZE);
+	*--sp = 0;			// thread_start's return address
+	*--sp = (uint32_t) thread_start;
+	sp -= 4;
+	t->t_esp = (uint32_t) sp;
+	nthreads++;
+	return t;
+}
+
+// Run thread t until it yields.  Only the main thread runs threads.
+void
+thread_run(struct Thread *t)
+{
+	int r;
+
+	assert(curthread == &threads[0] && t != curthread);
+	if (uxstack_owner != t) {
+		if ((r = sys_page_map(0, t->t_uxstack, 0,
+				      (void *) (UXSTACKTOP - PGSIZE),
+				      PTE_P|PTE_U|PTE_W)) < 0)
+			panic("thread_run: sys_page_map: %e", r);
+		uxstack_owner = t;
+	}
+	curthread = t;
+	thread_switch(&threads[0].t_esp, t->t_esp);
+}
+
+// Give the CPU back to the main thread.  In the main thread, return
+// at once: it has nobody to wait for.
+void
+thread_yield(void)
+{
+	struct Thread *t = curthread;
+
+	if (t == &threads[0])
+		return;
+	curthread = &threads[0];
+	thread_switch(&t->t_esp, threads[0].t_esp);
+}
+
+// Wait until l is free, then hold it exclusively.  A thread that holds
+// l exclusively may lock it again.
+void
+tlock_lock(struct tlock *l)
+{
+	if (l->l_owner == curthread) {
+		l->l_depth++;
+		return;
+	}
+	l->l_waiting++;
+	while (l->l_owner || l->l_shared) {
+		if (curthread == &threads[0])
+			panic("tlock_lock: contended in the main thread");
+		thread_yield();
+	}
+	l->l_waiting--;
+	l->l_owner = curthread;
+	l->l_depth = 1;
+}
+
+// Wait until nobody holds or is waiting to hold l exclusively, then
+// hold it shared with any other readers.
+void
+tlock_lock_shared(struct tlock *l)
+{
+	if (l->l_owner == curthread) {
+		l->l_depth++;
+		return;
+	}
+	while (l->l_owner || l->l_waiting) {
+		if (curthread == &threads[0])
+			panic("tlock_lock_shared: contended in the main thread");
+		thread_yield();
+	}
+	l->l_shared++;
+}
+
+void
+tlock_unlock(struct tlock *l)
+{
+	if (l->l_owner == curthread) {
+		if (--l->l_depth == 0)
+			l->l_owner = NULL;
+	} else {
+		assert(l->l_shared > 0);
+		l->l_shared--;
+	}
+}
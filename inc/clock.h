@@ -0,0 +1,29 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_INC_CLOCK_H
+#define JOS_INC_CLOCK_H
+
+#include <inc/types.h>
+
+#define NSEC_PER_SEC	1000000000ULL
+
+// The system clock page, mapped read-only for users at UCLOCK.
+// The kernel fills it in once at boot after calibrating the TSC, so
+// user code can tell time by reading the TSC, without a system call.
+struct ClockPage {
+	uint64_t cp_tsc_hz;	// TSC ticks per second
+	uint64_t cp_boot_tsc;	// TSC value at cp_boot_epoch
+	uint32_t cp_boot_epoch;	// Seconds since 1970-01-01 00:00 UTC, from the RTC
+};
+
+// Convert a TSC reading to nanoseconds since cp_boot_tsc.
+// Splitting whole seconds off first keeps the product from overflowing.
+static inline uint64_t
+clock_tsc2nsec(const volatile struct ClockPage *cp, uint64_t tsc)
+{
+	uint64_t hz = cp->cp_tsc_hz, delta = tsc - cp->cp_boot_tsc;
+
+	return delta / hz * NSEC_PER_SEC + delta % hz * NSEC_PER_SEC / hz;
+}
+
+#endif /* !JOS_INC_CLOCK_H */
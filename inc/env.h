@@ -44,6 +44,25 @@ enum EnvType {
 	ENV_TYPE_FS,		// File system server
 };
 
+// IPC page ranges.  The permission argument of an IPC system call may
+// carry page counts above its PTE bits.  With IPC_SENDPAGES(n), the
+// message carries the n consecutive pages starting at srcva; with
+// IPC_RECVPAGES(n), the caller accepts up to n pages at dstva.  Either
+// count defaults to one page.  Only sys_ipc_call and
+// sys_ipc_reply_wait both take a permission and receive, so only they
+// can receive a range.
+#define IPC_SENDPAGES(n)	(((uint32_t) (n) - 1) << 12)
+#define IPC_RECVPAGES(n)	(((uint32_t) (n) - 1) << 22)
+#define IPC_PGPERM(perm)	((perm) & 0xFFF)
+#define IPC_NSEND(perm)		((((uint32_t) (perm) >> 12) & 0x3FF) + 1)
+#define IPC_NRECV(perm)		((((uint32_t) (perm) >> 22) & 0x3FF) + 1)
+
+// A FIFO of environments blocked in the kernel (see kern/wait.c).
+struct WaitQueue {
+	struct Env *wq_head;
+	struct Env *wq_tail;
+};
+
 struct Env {
 	struct Trapframe env_tf;	// Saved registers
 	struct Env *env_link;		// Next free Env
@@ -52,6 +71,7 @@ struct Env {
 	enum EnvType env_type;		// Indicates special system environments
 	unsigned env_status;		// Status of the environment
 	uint32_t env_runs;		// Number of times environment has run
+	uint32_t env_syscalls;		// Number of system call traps
 	int env_cpunum;			// The CPU that the env is running on
 
 	// Address space
@@ -66,6 +86,34 @@ struct Env {
 	uint32_t env_ipc_value;		// Data value sent to us
 	envid_t env_ipc_from;		// envid of the sender
 	int env_ipc_perm;		// Perm of page mapping received
+	int env_ipc_npages;		// Number of pages received
+	int env_ipc_dstpages;		// Size of receive window in pages
+	struct WaitQueue env_ipc_senders; // Envs blocked sending to us
+	uint32_t env_ipc_send_value;	// Message we are blocked sending
+	void *env_ipc_send_srcva;
+	int env_ipc_send_perm;
+	envid_t env_ipc_waitfrom;	// Only accept messages from this env
+	bool env_ipc_calling;		// Blocked in sys_ipc_call's send
+	bool env_ipc_regs;		// Also return messages in registers
+
+	// Blocking in the kernel
+	struct WaitQueue *env_waitq;	// Queue we are blocked on, or NULL
+	struct Env *env_wait_next;	// Links in env_waitq
+	struct Env *env_wait_prev;
+	struct WaitQueue env_exitq;	// Envs waiting for us to exit
+	physaddr_t env_futex_pa;	// Futex word we are blocked on
+
+	// Asynchronous notification
+	uint32_t env_notify;		// Pending notification bits
+	uint32_t env_notify_mask;	// Bits we are blocked waiting for
+
+	// Timeouts (see kern/timer.c)
+	uint64_t env_next_timeout;	// Timeout for our next system call
+	uint64_t env_wait_timeout;	// Timeout if this call blocks, or 0
+	uint64_t env_timer_expire;	// Tick at which our timer fires
+	bool env_timer_armed;		// We are on the timer wheel
+	struct Env *env_timer_next;	// Links in our timer wheel slot
+	struct Env *env_timer_prev;
 };
 
 #endif // !JOS_INC_ENV_H
@@ -16,6 +16,8 @@ enum {
 
 	E_IPC_NOT_RECV	,	// Attempt to send to env that is not recving
 	E_EOF		,	// Unexpected end of file
+	E_AGAIN		,	// Condition changed; try again
+	E_TIMEOUT	,	// Timed out waiting
 
 	// File system error codes -- only seen in user-level
 	E_NO_DISK	,	// No free space left on disk
@@ -24,23 +24,58 @@
 // Number of direct block pointers in an indirect block
 #define NINDIRECT	(BLKSIZE / 4)
 
+// Largest file mapped with block pointers.  Files mapped with extents
+// are limited only by off_t and the size of the disk.
 #define MAXFILESIZE	((NDIRECT + NINDIRECT) * BLKSIZE)
 
+// A run of e_len file blocks starting at file block e_lblk, stored in
+// the disk blocks starting at e_pblk.
+struct Extent {
+	uint32_t e_lblk;
+	uint32_t e_pblk;
+	uint32_t e_len;
+} __attribute__((packed));
+
+// Number of extents in a File descriptor
+#define NFEXTENTS	5
+
 struct File {
 	char f_name[MAXNAMELEN];	// filename
 	off_t f_size;			// file size in bytes
 	uint32_t f_type;		// file type
 
-	// Block pointers.
+	// Block pointers, used unless FILE_EXTENTS is set.
 	// A block is allocated iff its value is != 0.
 	uint32_t f_direct[NDIRECT];	// direct blocks
 	uint32_t f_indirect;		// indirect block
 
-	// Pad out to 256 bytes; must do arithmetic in case we're compiling
-	// fsformat on a 64-bit machine.
-	uint8_t f_pad[256 - MAXNAMELEN - 8 - 4*NDIRECT - 4];
+	// Extents, used if FILE_EXTENTS is set: sorted by e_lblk, the
+	// first NFEXTENTS in f_extent and the rest in a chain of
+	// extent blocks.  A block is allocated iff an extent covers it.
+	uint32_t f_flags;		// FILE_* flags
+	uint32_t f_nextents;		// number of extents
+	struct Extent f_extent[NFEXTENTS];
+	uint32_t f_extblock;		// first extent block, or 0
+
+	// Directories: root block of the name index, or 0 if the
+	// directory has none and must be searched linearly.
+	uint32_t f_dirindex;
+
+	// That makes 256 bytes, which fs_init and fsformat check.
 } __attribute__((packed));	// required only on some 64-bit machines
 
+// File flags
+#define FILE_EXTENTS	0x1	// Blocks are mapped with extents
+
+// An extent block holds NBLKEXTENTS more extents of a file.
+#define NBLKEXTENTS	((BLKSIZE - 8) / sizeof(struct Extent))
+
+struct ExtentBlock {
+	uint32_t eb_next;		// next extent block, or 0
+	uint32_t eb_pad;
+	struct Extent eb_extent[NBLKEXTENTS];
+} __attribute__((packed));
+
 // An inode block contains exactly BLKFILES 'struct File's
 #define BLKFILES	(BLKSIZE / sizeof(struct File))
 
@@ -49,6 +84,42 @@ struct File {
 #define FTYPE_DIR	1	// Directory
 
 
+// Directory name index: an extendible hash table.  The low di_depth
+// bits of a name's dirhash pick one of the root's di_leaf pointers;
+// the leaf it points to lists the hash and directory slot (entry
+// number within the directory) of each name in that part of the
+// table.  A leaf that fills up is split in two, doubling the root's
+// table first if needed.
+#define DIRINDEX_MAXDEPTH	9
+#define DIRINDEX_NLEAF		(1 << DIRINDEX_MAXDEPTH)
+#define NLEAFENTS		((BLKSIZE - 8) / 8)
+
+struct DirIndex {
+	uint32_t di_depth;		// bits of hash used to pick a leaf
+	uint32_t di_freehint;		// every slot below this is in use
+	uint32_t di_leaf[DIRINDEX_NLEAF];
+};
+
+struct DirLeaf {
+	uint32_t dl_depth;		// bits of hash shared by all entries
+	uint32_t dl_count;		// entries in use
+	struct {
+		uint32_t de_hash;
+		uint32_t de_slot;
+	} dl_ent[NLEAFENTS];
+};
+
+// The hash of a file name used by the directory index (32-bit FNV-1a).
+static inline uint32_t
+dirhash(const char *name)
+{
+	uint32_t h = 2166136261U;
+
+	while (*name)
+		h = (h ^ (uint8_t) *name++) * 16777619U;
+	return h;
+}
+
 // File system super-block (both in-memory and on-disk)
 
 #define FS_MAGIC	0x4A0530AE	// related vaguely to 'J\0S!'
@@ -57,8 +128,12 @@ struct Super {
 	uint32_t s_magic;		// Magic number: FS_MAGIC
 	uint32_t s_nblocks;		// Total number of blocks on disk
 	struct File s_root;		// Root directory node
+	uint32_t s_features;		// FS_FEAT_* flags
 };
 
+// File system features
+#define FS_FEAT_EXTENTS	0x1	// New files are mapped with extents
+
 // Definitions for requests from clients to file system
 enum {
 	FSREQ_OPEN = 1,
@@ -70,9 +145,44 @@ enum {
 	FSREQ_STAT,
 	FSREQ_FLUSH,
 	FSREQ_REMOVE,
-	FSREQ_SYNC
+	FSREQ_SYNC,
+	// Range requests send the request page followed by up to
+	// FSREQ_MAXPAGES data pages, which hold the data read or written
+	FSREQ_READ_RANGE,
+	FSREQ_WRITE_RANGE,
+	// Block cache statistics; returns a BcStat on the request page
+	FSREQ_BCSTAT,
+	// File system usage; returns a Statfs on the request page
+	FSREQ_STATFS
+};
+
+// File system usage, in blocks.
+struct Statfs {
+	uint32_t sf_nblocks;	// Blocks on the disk
+	uint32_t sf_nfree;	// Free blocks
 };
 
+// File server cache counters.  Hits and misses count block lookups
+// that found the block mapped or had to read it from disk.
+struct BcStat {
+	uint32_t bs_limit;	// Most blocks the cache holds
+	uint32_t bs_cached;	// Blocks in the cache
+	uint32_t bs_hits;
+	uint32_t bs_misses;
+	uint32_t bs_evictions;
+	uint32_t bs_dirty;	// Cached blocks not yet written back
+	uint32_t bs_ramax;	// Largest read-ahead window, in blocks
+
+	// Directory entry cache: lookups answered with a file, answered
+	// with "not found", and not answered.
+	uint32_t bs_dhits;
+	uint32_t bs_dneg_hits;
+	uint32_t bs_dmisses;
+};
+
+// Most data pages in one range request
+#define FSREQ_MAXPAGES	16
+
 union Fsipc {
 	struct Fsreq_open {
 		char req_path[MAXPATHLEN];
@@ -108,6 +218,16 @@ union Fsipc {
 	struct Fsreq_remove {
 		char req_path[MAXPATHLEN];
 	} remove;
+	struct Fsreq_range {
+		int req_fileid;
+		size_t req_n;
+	} range;
+	struct Fsreq_bcstat {
+		int req_limit;		// New cache size in blocks, or 0
+		int req_ramax;		// New read-ahead limit, or < 0
+	} bcstat;
+	struct BcStat bcstatRet;
+	struct Statfs statfsRet;
 
 	// Ensure Fsipc is one page
 	char _pad[PGSIZE];
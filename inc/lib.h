@@ -20,6 +20,7 @@
 #include <inc/fs.h>
 #include <inc/fd.h>
 #include <inc/args.h>
+#include <inc/clock.h>
 
 #define USED(x)		(void)(x)
 
@@ -33,6 +34,7 @@ extern const char *binaryname;
 extern const volatile struct Env *thisenv;
 extern const volatile struct Env envs[NENV];
 extern const volatile struct PageInfo pages[];
+extern const volatile struct ClockPage uclock;
 
 // exit.c
 void	exit(void);
@@ -44,6 +46,14 @@ void	set_pgfault_handler(void (*handler)(struct UTrapframe *utf));
 char*	readline(const char *buf);
 
 // syscall.c
+extern int sysenter_enabled;
+// A message received by sys_ipc_call or sys_ipc_reply_wait.
+struct IpcMsg {
+	uint32_t value;
+	envid_t from;
+	int perm;
+};
+
 void	sys_cputs(const char *string, size_t len);
 int	sys_cgetc(void);
 envid_t	sys_getenvid(void);
@@ -59,6 +69,26 @@ int	sys_page_map(envid_t src_env, void *src_pg,
 int	sys_page_unmap(envid_t env, void *pg);
 int	sys_ipc_try_send(envid_t to_env, uint32_t value, void *pg, int perm);
 int	sys_ipc_recv(void *rcv_pg);
+int	sys_ipc_send(envid_t to_env, uint32_t value, void *pg, int perm);
+int	sys_ipc_call(envid_t to_env, uint32_t value, void *pg, int perm,
+		     void *rcv_pg, struct IpcMsg *msg);
+int	sys_ipc_reply_wait(envid_t to_env, uint32_t value, void *pg, int perm,
+			   void *rcv_pg, struct IpcMsg *msg);
+int	sys_env_wait(envid_t env);
+int	sys_cgetc_wait(void);
+int	sys_futex_wait(volatile uint32_t *addr, uint32_t expected);
+int	sys_futex_wait_pageref(volatile uint32_t *addr, uint32_t expected,
+			       int refs);
+int	sys_futex_wake(volatile uint32_t *addr, uint32_t n);
+int	sys_notify(envid_t env, uint32_t bits);
+int	sys_wait_notify(uint32_t mask);
+int	sys_batch(void);
+int	sys_page_map_range(envid_t src_env, void *src_pg,
+			   envid_t dst_env, void *dst_pg, size_t len, int perm);
+int	sys_page_unmap_range(envid_t env, void *pg, size_t len);
+int	sys_page_protect_range(envid_t env, void *pg, size_t len, int perm);
+int	sys_sleep(uint64_t nsec);
+int	sys_set_timeout(uint64_t nsec);
 
 int sys_print_pgdir_va_info(pde_t * pgdir, void * va);
 
@@ -73,9 +103,22 @@ sys_exofork(void)
 	return ret;
 }
 
+// batch.c
+extern int sysbatch_max;
+int	sysbatch(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3,
+		 uint32_t a4, uint32_t a5);
+int	sysbatch_flush(void);
+void	sysbatch_discard(void);
+
 // ipc.c
 void	ipc_send(envid_t to_env, uint32_t value, void *pg, int perm);
 int32_t ipc_recv(envid_t *from_env_store, void *pg, int *perm_store);
+int32_t	ipc_recv_timeout(envid_t *from_env_store, void *pg, int *perm_store,
+			 uint64_t nsec);
+int32_t	ipc_call(envid_t to_env, uint32_t value, void *pg, int perm,
+		 void *rcv_pg, int *perm_store);
+int32_t	ipc_reply_wait(envid_t to_env, uint32_t value, void *pg, int perm,
+		       void *rcv_pg, envid_t *from_env_store, int *perm_store);
 envid_t	ipc_find_env(enum EnvType type);
 
 // fork.c
@@ -99,6 +142,8 @@ int	open(const char *path, int mode);
 int	ftruncate(int fd, off_t size);
 int	remove(const char *path);
 int	sync(void);
+int	fs_bcstat(int limit, int ramax, struct BcStat *st);
+int	statfs(struct Statfs *st);
 
 // pageref.c
 int	pageref(void *addr);
@@ -121,6 +166,50 @@ int	pipeisclosed(int pipefd);
 // wait.c
 void	wait(envid_t env);
 
+// mutex.c
+#define FUTEX_WAKE_ALL	0xffffffff
+struct mutex {
+	volatile uint32_t m_state;	// 0: free, 1: held, 2: held, contended
+	volatile envid_t m_owner;	// Holder, for adaptive spinning
+};
+struct cond {
+	volatile uint32_t c_seq;	// Bumped by every signal
+};
+void	mutex_init(struct mutex *m);
+void	mutex_lock(struct mutex *m);
+int	mutex_trylock(struct mutex *m);
+void	mutex_unlock(struct mutex *m);
+void	cond_init(struct cond *c);
+void	cond_wait(struct cond *c, struct mutex *m);
+void	cond_signal(struct cond *c);
+void	cond_broadcast(struct cond *c);
+
+// ring.c
+#define RING_CACHELINE	64
+struct Ring {
+	// Written by the producer
+	volatile uint32_t r_head;	// Bytes ever written
+	volatile uint32_t r_wclosed;	// Producer closed its end
+	volatile uint32_t r_pwait;	// Producer may be asleep on r_tail
+	uint32_t r_size;		// Buffer size, a power of two
+	uint8_t r_pad0[RING_CACHELINE - 16];
+	// Written by the consumer
+	volatile uint32_t r_tail;	// Bytes ever read
+	volatile uint32_t r_rclosed;	// Consumer closed its end
+	volatile uint32_t r_cwait;	// Consumer may be asleep on r_head
+	uint8_t r_pad1[RING_CACHELINE - 12];
+	// The data pages follow the header page.
+};
+int	ring_create(struct Ring *r, size_t npages);
+ssize_t	ring_write(struct Ring *r, const void *buf, size_t n);
+ssize_t	ring_read(struct Ring *r, void *buf, size_t n);
+void	ring_close_write(struct Ring *r);
+void	ring_close_read(struct Ring *r);
+
+// time.c
+uint64_t time_nsec(void);
+uint32_t time_epoch(void);
+
 /* File open modes */
 #define	O_RDONLY	0x0000		/* open for reading only */
 #define	O_WRONLY	0x0001		/* open for writing only */
@@ -18,7 +18,48 @@ enum {
 	SYS_ipc_try_send,
 	SYS_ipc_recv,
 	SYS_print_pgdir_va_info,
+	SYS_env_wait,
+	SYS_cgetc_wait,
+	SYS_futex_wait,
+	SYS_futex_wake,
+	SYS_ipc_send,
+	SYS_ipc_call,
+	SYS_ipc_reply_wait,
+	SYS_notify,
+	SYS_wait_notify,
+	SYS_batch,
+	SYS_page_map_range,
+	SYS_page_unmap_range,
+	SYS_page_protect_range,
+	SYS_sleep,
+	SYS_set_timeout,
 	NSYSCALLS
 };
 
+#include <inc/types.h>
+
+// Notification bits (sys_notify, sys_wait_notify).  The top bit is
+// reserved, so that sys_wait_notify can return either the bits it took
+// or a negative error code.
+#define NOTIFY_BITS	0x7FFFFFFF
+
+// Batched system calls.  Each environment may map a ring of system
+// call descriptors at USYSRING.  It queues calls at sr_head; SYS_batch
+// runs every queued call in order, stores each result in its entry's
+// se_result and advances sr_tail past it.  Only calls that cannot
+// block or switch environments may be batched.
+#define SRING_SIZE	128	// Entries in the ring; a power of two
+
+struct SyscallEntry {
+	uint32_t se_num;		// System call number
+	uint32_t se_args[5];		// Arguments
+	int32_t se_result;		// Written by the kernel
+};
+
+struct SyscallRing {
+	volatile uint32_t sr_head;	// Next entry to queue (user)
+	volatile uint32_t sr_tail;	// Next entry to run (kernel)
+	struct SyscallEntry sr_ent[SRING_SIZE];
+};
+
 #endif /* !JOS_INC_SYSCALL_H */
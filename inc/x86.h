@@ -240,6 +240,28 @@ cpuid(uint32_t info, uint32_t *eaxp, uint32_t *ebxp, uint32_t *ecxp, uint32_t *e
 		*edxp = edx;
 }
 
+// CPUID leaf 1 %edx feature bits
+#define CPUID_FEAT_SEP		0x00000800	// SYSENTER/SYSEXIT
+
+// Model-specific registers
+#define MSR_SYSENTER_CS		0x174	// Kernel %cs for SYSENTER
+#define MSR_SYSENTER_ESP	0x175	// Kernel %esp for SYSENTER
+#define MSR_SYSENTER_EIP	0x176	// Kernel entry point for SYSENTER
+
+static inline uint64_t
+rdmsr(uint32_t msr)
+{
+	uint64_t val;
+	asm volatile("rdmsr" : "=A" (val) : "c" (msr));
+	return val;
+}
+
+static inline void
+wrmsr(uint32_t msr, uint64_t val)
+{
+	asm volatile("wrmsr" : : "c" (msr), "A" (val));
+}
+
 static inline uint64_t
 read_tsc(void)
 {
@@ -261,4 +283,28 @@ xchg(volatile uint32_t *addr, uint32_t newval)
 	return result;
 }
 
+// Atomically add 'val' to *addr and return the previous value.
+static inline uint32_t
+xadd(volatile uint32_t *addr, uint32_t val)
+{
+	asm volatile("lock; xaddl %0, %1"
+		     : "+r" (val), "+m" (*addr)
+		     : : "memory", "cc");
+	return val;
+}
+
+// Atomically set *addr to 'newval' if it equals 'oldval'.
+// Returns the value *addr held before the operation.
+static inline uint32_t
+cmpxchg(volatile uint32_t *addr, uint32_t oldval, uint32_t newval)
+{
+	uint32_t result;
+
+	asm volatile("lock; cmpxchgl %2, %1"
+		     : "=a" (result), "+m" (*addr)
+		     : "r" (newval), "0" (oldval)
+		     : "memory", "cc");
+	return result;
+}
+
 #endif /* !JOS_INC_X86_H */
@@ -9,6 +9,7 @@
 #include <kern/console.h>
 #include <kern/trap.h>
 #include <kern/picirq.h>
+#include <kern/wait.h>
 
 static void cons_intr(int (*proc)(void));
 static void cons_putc(int c);
@@ -414,6 +415,21 @@ cons_intr(int (*proc)(void))
 	}
 }
 
+// Environments blocked in sys_cgetc_wait.
+struct WaitQueue cons_waitq;
+
+// Hand pending input characters to environments waiting for them.
+// Called after keyboard and serial interrupts, and on every clock
+// tick in case an interrupt was missed.
+void
+cons_wakeup(void)
+{
+	int c;
+
+	while (!wq_empty(&cons_waitq) && (c = cons_getc()) != 0)
+		wq_wakeup_one(&cons_waitq, c);
+}
+
 // return the next input character from the console, or 0 if none waiting
 int
 cons_getc(void)
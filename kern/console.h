@@ -23,4 +23,8 @@ int cons_getc(void);
 void kbd_intr(void); // irq 1
 void serial_intr(void); // irq 4
 
+struct WaitQueue;
+extern struct WaitQueue cons_waitq;
+void cons_wakeup(void);
+
 #endif /* _CONSOLE_H_ */
@@ -2,14 +2,25 @@
 #ifndef JOS_INC_CPU_H
 #define JOS_INC_CPU_H
 
-#include <inc/types.h>
 #include <inc/memlayout.h>
-#include <inc/mmu.h>
-#include <inc/env.h>
 
 // Maximum number of CPUs
 #define NCPU  8
 
+// Per-CPU data segments, one per CPU after the TSS descriptors.
+// While in the kernel, %gs holds this CPU's selector, so per-CPU
+// data is one %gs-relative load away.  Entry code finds the selector
+// from the task register: GD_PCPU0 + (TSS selector - GD_TSS0).
+#define GD_PCPU0	(GD_TSS0 + (NCPU << 3))
+
+#define CPU_CACHELINE	64
+
+#ifndef __ASSEMBLER__
+
+#include <inc/types.h>
+#include <inc/mmu.h>
+#include <inc/env.h>
+
 // Values of status in struct Cpu
 enum {
 	CPU_UNUSED = 0,
@@ -17,13 +28,16 @@ enum {
 	CPU_HALTED,
 };
 
-// Per-CPU state
+// Per-CPU state.  Each CPU's entry starts on its own cache line, so
+// CPUs updating their own state do not steal lines from each other.
+// The hot fields come first.
 struct CpuInfo {
+	struct CpuInfo *cpu_self;       // This entry, for thiscpu
+	struct Env *cpu_env;            // The currently-running environment.
 	uint8_t cpu_id;                 // Local APIC ID; index into cpus[] below
 	volatile unsigned cpu_status;   // The status of the CPU
-	struct Env *cpu_env;            // The currently-running environment.
 	struct Taskstate cpu_ts;        // Used by x86 to find stack for interrupt
-};
+} __attribute__((aligned(CPU_CACHELINE)));
 
 // Initialized in mpconfig.c
 extern struct CpuInfo cpus[NCPU];
@@ -34,8 +48,25 @@ extern physaddr_t lapicaddr;        // Physical MMIO address of the local APIC
 // Per-CPU kernel stacks
 extern unsigned char percpu_kstacks[NCPU][KSTKSIZE];
 
+// Read or write a field of this CPU's struct CpuInfo with a single
+// %gs-relative instruction.  Only valid once trap_init_percpu has run.
+#define percpu_read(field) ({						\
+	typeof(((struct CpuInfo *) 0)->field) __v;			\
+	asm volatile("mov %%gs:%c1, %0"					\
+		     : "=r" (__v) : "i" (offsetof(struct CpuInfo, field)));	\
+	__v;								\
+})
+#define percpu_write(field, v) do {					\
+	typeof(((struct CpuInfo *) 0)->field) __v = (v);		\
+	asm volatile("mov %0, %%gs:%c1"					\
+		     : : "r" (__v), "i" (offsetof(struct CpuInfo, field))	\
+		     : "memory");					\
+} while (0)
+
+// cpunum reads the local APIC's ID register, an uncached MMIO load;
+// thiscpu and curenv are much cheaper once %gs is set up.
 int cpunum(void);
-#define thiscpu (&cpus[cpunum()])
+#define thiscpu (percpu_read(cpu_self))
 
 void mp_init(void);
 void lapic_init(void);
@@ -43,4 +74,6 @@ void lapic_startap(uint8_t apicid, uint32_t addr);
 void lapic_eoi(void);
 void lapic_ipi(int vector);
 
+#endif	// !__ASSEMBLER__
+
 #endif
@@ -14,6 +14,10 @@
 #include <kern/sched.h>
 #include <kern/cpu.h>
 #include <kern/spinlock.h>
+#include <kern/wait.h>
+#include <kern/futex.h>
+#include <kern/syscall.h>
+#include <kern/timer.h>
 
 struct Env *envs = NULL;		// All environments
 static struct Env *env_free_list;	// Free environment list
@@ -36,7 +40,7 @@ static struct Env *env_free_list;	// Free environment list
 // definition of gdt specifies the Descriptor Privilege Level (DPL)
 // of that descriptor: 0 for kernel and 3 for user.
 //
-struct Segdesc gdt[NCPU + 5] =
+struct Segdesc gdt[2 * NCPU + 5] =
 {
 	// 0x0 - unused (always faults -- for trapping NULL far pointers)
 	SEG_NULL,
@@ -53,7 +57,8 @@ struct Segdesc gdt[NCPU + 5] =
 	// 0x20 - user data segment
 	[GD_UD >> 3] = SEG(STA_W, 0x0, 0xffffffff, 3),
 
-	// Per-CPU TSS descriptors (starting from GD_TSS0) are initialized
+	// Per-CPU TSS descriptors (starting from GD_TSS0) and per-CPU
+	// data segments (starting from GD_PCPU0) are initialized
 	// in trap_init_percpu()
 
 	// 0x28 - tss, initialized in trap_init_percpu()
@@ -133,13 +138,26 @@ env_init(void)
 }
 
 // Load GDT and segment descriptors.
+// This is the first thing each CPU does, since thiscpu and curenv
+// only work once %gs holds the CPU's per-CPU segment.
 void
 env_init_percpu(void)
 {
+	// cpunum() reads the local APIC; on the boot CPU it is not
+	// mapped yet, and cpunum() returns 0.
+	int id = cpunum();
+
+	// Per-CPU data segment, based at this CPU's struct CpuInfo.
+	// The trap entry code reloads %gs from it, since user code
+	// may leave anything there.
+	cpus[id].cpu_self = &cpus[id];
+	gdt[(GD_PCPU0 >> 3) + id] = (struct Segdesc)
+		SEG(STA_W, (uint32_t) &cpus[id], sizeof(struct CpuInfo) - 1, 0);
+
 	lgdt(&gdt_pd);
-	// The kernel never uses GS or FS, so we leave those set to
-	// the user data segment.
-	asm volatile("movw %%ax,%%gs" : : "a" (GD_UD|3));
+	asm volatile("movw %%ax,%%gs" : : "a" (GD_PCPU0 + (id << 3)));
+	// The kernel never uses FS, so we leave it set to the user data
+	// segment.
 	asm volatile("movw %%ax,%%fs" : : "a" (GD_UD|3));
 	// The kernel does use ES, DS, and SS.  We'll change between
 	// the kernel and user data segments as needed.
@@ -246,6 +264,7 @@ env_alloc(struct Env **newenv_store, envid_t parent_id)
 	e->env_type = ENV_TYPE_USER;
 	e->env_status = ENV_RUNNABLE;
 	e->env_runs = 0;
+	e->env_syscalls = 0;
 
 	// Clear out all the saved register state,
 	// to prevent the register values
@@ -277,6 +296,22 @@ env_alloc(struct Env **newenv_store, envid_t parent_id)
 
 	// Also clear the IPC receiving flag.
 	e->env_ipc_recving = 0;
+	e->env_ipc_waitfrom = 0;
+	e->env_ipc_calling = 0;
+	e->env_ipc_regs = 0;
+	e->env_ipc_npages = 0;
+
+	// No notifications pending.
+	e->env_notify = 0;
+	e->env_notify_mask = 0;
+	e->env_next_timeout = e->env_wait_timeout = 0;
+	e->env_timer_armed = false;
+
+	// Nobody is blocked on, or waiting for, the new environment.
+	e->env_waitq = NULL;
+	e->env_wait_next = e->env_wait_prev = NULL;
+	wq_init(&e->env_exitq);
+	wq_init(&e->env_ipc_senders);
 
 	// commit the allocation
 	env_free_list = e->env_link;
@@ -471,6 +506,7 @@ env_free(struct Env *e)
 	pte_t *pt;
 	uint32_t pdeno, pteno;
 	physaddr_t pa;
+	bool futexes;
 
 	// If freeing the current environment, switch to kern_pgdir
 	// before freeing the page directory, just in case the page
@@ -481,6 +517,14 @@ env_free(struct Env *e)
 	// Note the environment's demise.
 	// cprintf("[%08x] free env %08x\n", curenv ? curenv->env_id : 0, e->env_id);
 
+	// Stop waiting for whatever we were blocked on,
+	// and release anyone waiting for us to exit.
+	wq_remove(e);
+	timer_cancel(e);
+	wq_wakeup_all(&e->env_exitq, 0);
+	ipc_env_free(e);
+	futexes = futex_waiting();
+
 	// Flush all mapped pages in the user portion of the address space
 	static_assert(UTOP % PTSIZE == 0);
 	for (pdeno = 0; pdeno < PDX(UTOP); pdeno++) {
@@ -495,8 +539,13 @@ env_free(struct Env *e)
 
 		// unmap all PTEs in this page table
 		for (pteno = 0; pteno <= PTX(~0); pteno++) {
-			if (pt[pteno] & PTE_P)
-				page_remove(e->env_pgdir, PGADDR(pdeno, pteno, 0));
+			if (!(pt[pteno] & PTE_P))
+				continue;
+			// Wake futex sleepers on pages we shared,
+			// e.g. the other end of a pipe.
+			if (futexes && pa2page(PTE_ADDR(pt[pteno]))->pp_ref > 1)
+				futex_wake_frame(PTE_ADDR(pt[pteno]));
+			page_remove(e->env_pgdir, PGADDR(pdeno, pteno, 0));
 		}
 
 		// free the page table itself
@@ -534,7 +583,7 @@ env_destroy(struct Env *e)
 	env_free(e);
 
 	if (curenv == e) {
-		curenv = NULL;
+		percpu_write(cpu_env, NULL);
 		sched_yield();
 	}
 }
@@ -550,7 +599,7 @@ void
 env_pop_tf(struct Trapframe *tf)
 {
 	// Record the CPU we are running on for user-space debugging
-	curenv->env_cpunum = cpunum();
+	curenv->env_cpunum = percpu_read(cpu_id);
 
 	asm volatile(
 		"\tmovl %0,%%esp\n"
@@ -597,7 +646,7 @@ env_run(struct Env *e)
 		// save register into trap;
 		// todo
 	}
-	curenv = e;
+	percpu_write(cpu_env, e);
 	curenv->env_status = ENV_RUNNING;
 	curenv->env_runs ++;
 	lcr3(PADDR(curenv->env_pgdir));
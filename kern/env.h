@@ -7,7 +7,7 @@
 #include <kern/cpu.h>
 
 extern struct Env *envs;		// All environments
-#define curenv (thiscpu->cpu_env)		// Current environment
+#define curenv (percpu_read(cpu_env))	// Current environment
 extern struct Segdesc gdt[];
 
 void	env_init(void);
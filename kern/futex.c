@@ -0,0 +1,112 @@
+// Futexes: user-space synchronization that sleeps in the kernel only
+// when it has to.  A futex is identified by the physical address of
+// its word, so environments that share a page (e.g., a pipe) agree on
+// it no matter where each of them maps the page.
+
+#include <inc/error.h>
+#include <inc/assert.h>
+
+#include <kern/env.h>
+#include <kern/pmap.h>
+#include <kern/futex.h>
+#include <kern/wait.h>
+
+#define NFUTEXHASH	64
+#define FUTEXHASH(pa)	(((pa) >> 2) % NFUTEXHASH)
+
+static struct WaitQueue futex_queues[NFUTEXHASH];
+
+// Find the physical address of the user word at addr in curenv.
+static int
+futex_lookup(uint32_t *addr, struct PageInfo **pp_store, physaddr_t *pa_store)
+{
+	struct PageInfo *pp;
+	pte_t *pte;
+
+	if ((uintptr_t) addr >= UTOP || ((uintptr_t) addr & 3))
+		return -E_INVAL;
+	pp = page_lookup(curenv->env_pgdir, addr, &pte);
+	if (!pp || !(*pte & PTE_P) || !(*pte & PTE_U))
+		return -E_FAULT;
+	*pp_store = pp;
+	*pa_store = page2pa(pp) + PGOFF(addr);
+	return 0;
+}
+
+// Block until woken by futex_wake on the same word, provided the word
+// still contains 'expected'.  If 'refs' is nonzero, the page holding
+// the word must also still be mapped exactly 'refs' times; this lets a
+// caller that looked at pageref() notice a concurrent unmap.
+//
+// Returns -E_AGAIN without blocking if either check fails.
+// Otherwise the system call returns 0 once woken.
+int
+futex_wait(uint32_t *addr, uint32_t expected, uint32_t refs)
+{
+	struct PageInfo *pp;
+	physaddr_t pa;
+	int r;
+
+	if ((r = futex_lookup(addr, &pp, &pa)) < 0)
+		return r;
+	if (*(uint32_t *) KADDR(pa) != expected)
+		return -E_AGAIN;
+	if (refs && pp->pp_ref != refs)
+		return -E_AGAIN;
+
+	curenv->env_futex_pa = pa;
+	wq_sleep(&futex_queues[FUTEXHASH(pa)]);
+}
+
+// Wake up to n environments waiting on the word at addr, oldest first.
+// Returns the number woken.
+int
+futex_wake(uint32_t *addr, uint32_t n)
+{
+	struct PageInfo *pp;
+	struct Env *e, *next;
+	physaddr_t pa;
+	uint32_t woken = 0;
+	int r;
+
+	if ((r = futex_lookup(addr, &pp, &pa)) < 0)
+		return r;
+	for (e = futex_queues[FUTEXHASH(pa)].wq_head; e && woken < n; e = next) {
+		next = e->env_wait_next;
+		if (e->env_futex_pa == pa) {
+			wq_wakeup_env(e, 0);
+			woken++;
+		}
+	}
+	return woken;
+}
+
+// Is anybody blocked on a futex?
+bool
+futex_waiting(void)
+{
+	int i;
+
+	for (i = 0; i < NFUTEXHASH; i++)
+		if (!wq_empty(&futex_queues[i]))
+			return true;
+	return false;
+}
+
+// Wake everyone blocked on a futex in the page at pa.
+// Called when a mapping of a shared page goes away, so that sleepers
+// watching the page's reference count (as pipes do) get to look again.
+void
+futex_wake_frame(physaddr_t pa)
+{
+	struct Env *e, *next;
+	int i;
+
+	pa = ROUNDDOWN(pa, PGSIZE);
+	for (i = 0; i < NFUTEXHASH; i++)
+		for (e = futex_queues[i].wq_head; e; e = next) {
+			next = e->env_wait_next;
+			if (ROUNDDOWN(e->env_futex_pa, PGSIZE) == pa)
+				wq_wakeup_env(e, 0);
+		}
+}
@@ -0,0 +1,16 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_FUTEX_H
+#define JOS_KERN_FUTEX_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+int futex_wait(uint32_t *addr, uint32_t expected, uint32_t refs);
+int futex_wake(uint32_t *addr, uint32_t n);
+bool futex_waiting(void);
+void futex_wake_frame(physaddr_t pa);
+
+#endif	// !JOS_KERN_FUTEX_H
@@ -29,9 +29,16 @@ i386_init(void)
 
 	cprintf("6828 decimal is %o octal!\n", 6828);
 
+	// Load the GDT and this CPU's per-CPU segment before anything
+	// uses thiscpu or curenv (even mem_init does, via tlb_invalidate).
+	env_init_percpu();
+
 	// Lab 2 memory management initialization functions
 	mem_init();
 
+	// Calibrate the TSC and set up the clock page
+	clock_init();
+
 	// Lab 3 user environment initialization functions
 	env_init();
 	trap_init();
@@ -119,9 +126,9 @@ mp_main(void)
 	lcr3(PADDR(kern_pgdir));
 	cprintf("SMP: CPU %d starting\n", cpunum());
 
-	lapic_init();
 	env_init_percpu();
 	trap_init_percpu();
+	lapic_init();
 	xchg(&thiscpu->cpu_status, CPU_STARTED); // tell boot_aps() we're up
 
 	// Now that we have finished some basic setup, call sched_yield()
@@ -1,8 +1,10 @@
 /* See COPYRIGHT for copyright information. */
 
-/* Support for reading the NVRAM from the real-time clock. */
+/* Support for reading the NVRAM and time from the real-time clock,
+ * and for calibrating the TSC against the PIT. */
 
 #include <inc/x86.h>
+#include <inc/stdio.h>
 
 #include <kern/kclock.h>
 
@@ -20,3 +22,121 @@ mc146818_write(unsigned reg, unsigned datum)
 	outb(IO_RTC, reg);
 	outb(IO_RTC+1, datum);
 }
+
+// The system clock page, allocated by mem_init and mapped at UCLOCK.
+struct ClockPage *clockpage;
+
+#define CALIBRATE_MS	10	// Length of one PIT calibration run
+#define CALIBRATE_RUNS	3
+
+// Count TSC ticks over CALIBRATE_MS milliseconds timed by PIT channel 2,
+// which is free for this: it normally only drives the speaker.
+// Returns 0 if the PIT never signals terminal count.
+static uint64_t
+pit_calibrate(void)
+{
+	uint32_t count = TIMER_FREQ * CALIBRATE_MS / 1000, spins = 0;
+	uint64_t start;
+
+	// Gate the channel on with the speaker off, and load the count;
+	// mode 0 raises OUT2 when it reaches zero.
+	outb(IO_PPI, (inb(IO_PPI) & ~PPI_SPKR) | PPI_GATE2);
+	outb(TIMER_MODE, TIMER_SEL2 | TIMER_16BIT | TIMER_INTTC);
+	outb(TIMER_CNTR2, count & 0xff);
+	outb(TIMER_CNTR2, count >> 8);
+
+	start = read_tsc();
+	while (!(inb(IO_PPI) & PPI_OUT2))
+		if (++spins == 0x10000000)
+			return 0;
+	return (read_tsc() - start) * TIMER_FREQ / count;
+}
+
+// Convert an RTC register value to binary; 'b' is status register B.
+static uint32_t
+rtc_bin(uint32_t v, uint8_t b)
+{
+	if (!(b & RTC_B_BINARY))
+		v = (v >> 4) * 10 + (v & 0xf);
+	return v;
+}
+
+// Read the RTC's time of day as seconds since the Unix epoch.
+static uint32_t
+rtc_epoch(void)
+{
+	static const uint16_t mdays[] = {
+		0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+	};
+	uint32_t sec, min, hour, day, mon, year, days;
+	uint8_t b;
+	bool pm;
+
+	while (mc146818_read(RTC_A) & RTC_A_UIP)
+		/* do nothing */;
+	b = mc146818_read(RTC_B);
+	sec = rtc_bin(mc146818_read(RTC_SEC), b);
+	min = rtc_bin(mc146818_read(RTC_MIN), b);
+	hour = mc146818_read(RTC_HOUR);
+	day = rtc_bin(mc146818_read(RTC_DAY), b);
+	mon = rtc_bin(mc146818_read(RTC_MONTH), b);
+	year = rtc_bin(mc146818_read(RTC_YEAR), b) + 2000;
+
+	// In 12-hour mode the top bit of the hour means PM.
+	pm = !(b & RTC_B_24H) && (hour & 0x80);
+	hour = rtc_bin(hour & 0x7f, b);
+	if (!(b & RTC_B_24H))
+		hour = hour % 12 + (pm ? 12 : 0);
+	if (mon < 1 || mon > 12)
+		return 0;
+
+	days = (year - 1970) * 365 + (year - 1969) / 4 + mdays[mon - 1] + day - 1;
+	if (mon > 2 && year % 4 == 0)
+		days++;
+	return ((days * 24 + hour) * 60 + min) * 60 + sec;
+}
+
+// Count TSC ticks over one RTC second.  Slow, but only used when the
+// PIT does not work.
+static uint64_t
+rtc_calibrate(void)
+{
+	uint32_t sec = mc146818_read(RTC_SEC);
+	uint64_t start;
+
+	while (mc146818_read(RTC_SEC) == sec)
+		/* do nothing */;
+	start = read_tsc();
+	sec = mc146818_read(RTC_SEC);
+	while (mc146818_read(RTC_SEC) == sec)
+		/* do nothing */;
+	return read_tsc() - start;
+}
+
+// Calibrate the TSC and fill in the clock page.
+// The shortest of a few PIT runs is the one least disturbed by
+// interrupts or (under emulation) by the host.
+void
+clock_init(void)
+{
+	uint64_t hz = 0, t;
+	int i;
+
+	for (i = 0; i < CALIBRATE_RUNS; i++)
+		if ((t = pit_calibrate()) && (!hz || t < hz))
+			hz = t;
+	if (!hz)
+		hz = rtc_calibrate();
+
+	clockpage->cp_tsc_hz = hz;
+	clockpage->cp_boot_epoch = rtc_epoch();
+	clockpage->cp_boot_tsc = read_tsc();
+	cprintf("TSC: %llu.%03llu MHz\n", hz / 1000000, hz / 1000 % 1000);
+}
+
+// Return the number of nanoseconds since clock_init.
+uint64_t
+clock_nsec(void)
+{
+	return clock_tsc2nsec(clockpage, read_tsc());
+}
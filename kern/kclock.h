@@ -6,8 +6,36 @@
 # error "This is a JOS kernel header; user programs should not #include it"
 #endif
 
+#include <inc/clock.h>
+
 #define	IO_RTC		0x070		/* RTC port */
 
+/* RTC time-of-day registers; values are BCD unless RTC_B_BINARY is set */
+#define	RTC_SEC		0x00
+#define	RTC_MIN		0x02
+#define	RTC_HOUR	0x04
+#define	RTC_DAY		0x07
+#define	RTC_MONTH	0x08
+#define	RTC_YEAR	0x09
+#define	RTC_A		0x0a	/* status register A */
+#define	  RTC_A_UIP	0x80	/*   update in progress */
+#define	RTC_B		0x0b	/* status register B */
+#define	  RTC_B_24H	0x02	/*   24-hour mode */
+#define	  RTC_B_BINARY	0x04	/*   binary, not BCD */
+
+/* 8253/8254 programmable interval timer */
+#define	IO_TIMER1	0x040		/* PIT channel 0 data port */
+#define	TIMER_CNTR2	(IO_TIMER1 + 2)	/* channel 2 data port */
+#define	TIMER_MODE	(IO_TIMER1 + 3)	/* mode/command port */
+#define	  TIMER_SEL2	0x80	/*   select channel 2 */
+#define	  TIMER_16BIT	0x30	/*   low byte, then high byte */
+#define	  TIMER_INTTC	0x00	/*   mode 0: OUT goes high at terminal count */
+#define	TIMER_FREQ	1193182		/* PIT input clock, Hz */
+#define	IO_PPI		0x061		/* keyboard controller port B */
+#define	  PPI_GATE2	0x01	/*   channel 2 gate */
+#define	  PPI_SPKR	0x02	/*   speaker enable */
+#define	  PPI_OUT2	0x20	/*   channel 2 output */
+
 #define	MC_NVRAM_START	0xe	/* start of NVRAM: offset 14 */
 #define	MC_NVRAM_SIZE	50	/* 50 bytes of NVRAM */
 
@@ -26,4 +54,9 @@
 unsigned mc146818_read(unsigned reg);
 void mc146818_write(unsigned reg, unsigned datum);
 
+extern struct ClockPage *clockpage;
+
+void clock_init(void);
+uint64_t clock_nsec(void);
+
 #endif	// !JOS_KERN_KCLOCK_H
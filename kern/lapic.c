@@ -9,6 +9,8 @@
 #include <inc/x86.h>
 #include <kern/pmap.h>
 #include <kern/cpu.h>
+#include <kern/kclock.h>
+#include <kern/timer.h>
 
 // Local APIC registers, divided by 4 for use as uint32_t[] indices.
 #define ID      (0x0020/4)   // ID
@@ -45,6 +47,9 @@
 physaddr_t lapicaddr;        // Initialized in mpconfig.c
 volatile uint32_t *lapic;
 
+// Timer count for one tick, measured once by the boot CPU.
+static uint32_t lapic_ticr;
+
 static void
 lapicw(int index, int value)
 {
@@ -52,6 +57,24 @@ lapicw(int index, int value)
 	lapic[ID];  // wait for write to finish, by reading
 }
 
+// Count how far the timer counts down in one tick (1/TIMER_HZ s)
+// timed by the calibrated TSC.  Without a TSC rate, guess.
+static uint32_t
+lapic_timer_calibrate(void)
+{
+	uint64_t hz = clockpage->cp_tsc_hz, start;
+
+	if (!hz)
+		return 10000000;
+	lapicw(TDCR, X1);
+	lapicw(TIMER, MASKED);
+	lapicw(TICR, 0xffffffff);
+	start = read_tsc();
+	while (read_tsc() - start < hz / TIMER_HZ)
+		/* do nothing */;
+	return 0xffffffff - lapic[TCCR];
+}
+
 void
 lapic_init(void)
 {
@@ -66,12 +89,14 @@ lapic_init(void)
 	lapicw(SVR, ENABLE | (IRQ_OFFSET + IRQ_SPURIOUS));
 
 	// The timer repeatedly counts down at bus frequency
-	// from lapic[TICR] and then issues an interrupt.  
-	// If we cared more about precise timekeeping,
-	// TICR would be calibrated using an external time source.
+	// from lapic[TICR] and then issues an interrupt.
+	// TICR is calibrated against the TSC so that the timer
+	// interrupts TIMER_HZ times a second.
+	if (!lapic_ticr)
+		lapic_ticr = lapic_timer_calibrate();
 	lapicw(TDCR, X1);
 	lapicw(TIMER, PERIODIC | (IRQ_OFFSET + IRQ_TIMER));
-	lapicw(TICR, 10000000); 
+	lapicw(TICR, lapic_ticr);
 
 	// Leave LINT0 of the BSP enabled so that it can get
 	// interrupts from the 8259A chip.
@@ -134,8 +159,6 @@ microdelay(int us)
 {
 }
 
-#define IO_RTC  0x70
-
 // Start additional processor running entry code at addr.
 // See Appendix B of MultiProcessor Specification.
 void
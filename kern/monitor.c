@@ -11,6 +11,7 @@
 #include <kern/monitor.h>
 #include <kern/kdebug.h>
 #include <kern/trap.h>
+#include <kern/spinlock.h>
 
 #define CMDBUF_SIZE	80	// enough for one VGA text line
 
@@ -26,6 +27,7 @@ static struct Command commands[] = {
 	{ "help", "Display this list of commands", mon_help },
 	{ "kerninfo", "Display information about the kernel", mon_kerninfo },
 	{ "backtrace", "Stack backtrace", mon_backtrace},
+	{ "lockstat", "Display spinlock statistics ('lockstat reset' clears them)", mon_lockstat },
 };
 
 /***** Implementations of basic kernel monitor commands *****/
@@ -79,6 +81,35 @@ mon_backtrace(int argc, char **argv, struct Trapframe *tf)
 	return 0;
 }
 
+int
+mon_lockstat(int argc, char **argv, struct Trapframe *tf)
+{
+#ifdef SPINLOCK_STATS
+	static const char * const types[] = { "tas", "ticket", "mcs" };
+	struct spinlock *lk;
+	int i;
+
+	if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+		for (i = 0; i < nspinlocks; i++)
+			memset(&spinlocks[i]->stat, 0, sizeof(spinlocks[i]->stat));
+		return 0;
+	}
+
+	cprintf("%-16s %-6s %12s %12s %16s %12s\n", "lock", "type",
+		"acquires", "contended", "spin cycles", "max hold");
+	for (i = 0; i < nspinlocks; i++) {
+		lk = spinlocks[i];
+		cprintf("%-16s %-6s %12llu %12llu %16llu %12llu\n",
+			lk->name ? lk->name : "?", types[lk->type],
+			lk->stat.acquires, lk->stat.contended,
+			lk->stat.spin_cycles, lk->stat.max_hold);
+	}
+#else
+	cprintf("Spinlock statistics are disabled in this build (SPINLOCK_STATS).\n");
+#endif
+	return 0;
+}
+
 
 
 /***** Kernel monitor command interpreter *****/
@@ -10,6 +10,7 @@
 #include <kern/kclock.h>
 #include <kern/env.h>
 #include <kern/cpu.h>
+#include <kern/futex.h>
 
 // These variables are set by i386_detect_memory()
 size_t npages;			// Amount of physical memory (in pages)
@@ -211,6 +212,13 @@ mem_init(void)
 	uintptr_t envs_end = (uintptr_t)boot_alloc(0);
 	memset((void *)envs, 0, sizeof(struct  Env)*NENV);
 
+	//////////////////////////////////////////////////////////////////////
+	// Allocate the system clock page; clock_init fills it in.
+	// It is mapped at the top of the envs slot, so envs must fit below.
+	static_assert(NENV * sizeof(struct Env) <= UCLOCK - UENVS);
+	clockpage = boot_alloc(PGSIZE);
+	memset(clockpage, 0, PGSIZE);
+
 	//////////////////////////////////////////////////////////////////////
 	// Now that we've allocated the initial kernel data structures, we set
 	// up the list of free physical pages. Once we've done so, all further
@@ -219,9 +227,11 @@ mem_init(void)
 	// or page_insert
 	page_init();
 
+#ifndef JOS_RELEASE
 	check_page_free_list(1);
 	check_page_alloc();
 	check_page();
+#endif
 
 	//////////////////////////////////////////////////////////////////////
 	// Now we set up virtual memory
@@ -266,6 +276,13 @@ mem_init(void)
 		envs_pa = envs_pa + PGSIZE;
 	}
 
+	//////////////////////////////////////////////////////////////////////
+	// Map the clock page read-only by the user at linear address UCLOCK
+	// Permissions:
+	//    - the new image at UCLOCK -- kernel R, user R
+	//    - clockpage itself -- kernel RW, user NONE
+	boot_map_region(kern_pgdir, UCLOCK, PGSIZE, PADDR(clockpage), PTE_U);
+
 	//////////////////////////////////////////////////////////////////////
 	// Use the physical memory that 'bootstack' refers to as the kernel
 	// stack.  The kernel stack grows down from virtual address KSTACKTOP.
@@ -347,9 +364,11 @@ mem_init(void)
 	mem_init_mp();
 
 	// Check that the initial page directory has been set up correctly.
+#ifndef JOS_RELEASE
 	cprintf("entry check\n");
 	check_kern_pgdir();
 	cprintf("out check\n");
+#endif
 
 	// Switch from the minimal entry page directory to the full kern_pgdir
 	// page table we just created.	Our instruction pointer should be
@@ -361,7 +380,9 @@ mem_init(void)
 	cprintf("kern_pgdir: %x\n", kern_pgdir);
 	lcr3(PADDR(kern_pgdir));
 
+#ifndef JOS_RELEASE
 	check_page_free_list(0);
+#endif
 
 	// entry.S set the really important flags in cr0 (including enabling
 	// paging).  Here we configure the rest of the flags that we care about.
@@ -371,7 +392,9 @@ mem_init(void)
 	lcr0(cr0);
 
 	// Some more checks, only possible after kern_pgdir is installed.
+#ifndef JOS_RELEASE
 	check_page_installed_pgdir();
+#endif
 }
 
 // Modify mappings in kern_pgdir to support SMP
@@ -714,7 +737,7 @@ page_lookup(pde_t *pgdir, void *va, pte_t **pte_store)
 {
 	// Fill this function in
 	pte_t * pte = pgdir_walk(pgdir, va, false);
-	if(!pte){
+	if(!pte || !(*pte & PTE_P)){
 		return NULL;
 	}
 	if(pte_store){
@@ -786,6 +809,151 @@ tlb_invalidate(pde_t *pgdir, void *va)
 		invlpg(va);
 }
 
+//
+// Flush the whole TLB, but only if the page tables being edited are
+// the ones currently in use by the processor.  Cheaper than one
+// invlpg per page once more than a few pages have changed.
+//
+static void
+tlb_flush(pde_t *pgdir)
+{
+	if (!curenv || curenv->env_pgdir == pgdir)
+		lcr3(PADDR(pgdir));
+}
+
+//
+// Starting at *va, find the next page below 'end' that is mapped in
+// pgdir.  Skips whole page tables that are not present.
+// Returns its PTE and sets *va to its address, or returns NULL.
+//
+static pte_t *
+next_present(pde_t *pgdir, uintptr_t *va, uintptr_t end)
+{
+	pte_t *pt;
+
+	while (*va < end) {
+		if (!(pgdir[PDX(*va)] & PTE_P)) {
+			*va = ROUNDDOWN(*va, PTSIZE) + PTSIZE;
+			continue;
+		}
+		pt = KADDR(PTE_ADDR(pgdir[PDX(*va)]));
+		if (pt[PTX(*va)] & PTE_P)
+			return &pt[PTX(*va)];
+		*va += PGSIZE;
+	}
+	return NULL;
+}
+
+//
+// Map every page mapped in [srcva, srcva+len) of srcpgdir at the same
+// offset from dstva in dstpgdir, with permissions 'perm|PTE_P'.
+// Unmapped pages are skipped, and replace nothing at the destination.
+// The TLB is flushed once at the end rather than once per page.
+// The ranges must be page-aligned, and must not overlap unless they
+// are the same range of the same page directory.
+//
+// RETURNS:
+//   0 on success
+//   -E_INVAL if perm includes PTE_W but a source page is read-only
+//     (nothing is mapped in that case)
+//   -E_NO_MEM if a page table couldn't be allocated
+//
+int
+page_map_range(pde_t *srcpgdir, uintptr_t srcva, pde_t *dstpgdir,
+	       uintptr_t dstva, size_t len, int perm)
+{
+	struct PageInfo *pp;
+	uintptr_t va;
+	pte_t *spte, *dpte;
+	bool changed = false;
+	int r = 0;
+
+	if (perm & PTE_W)
+		for (va = srcva; (spte = next_present(srcpgdir, &va, srcva + len)); va += PGSIZE)
+			if (!(*spte & PTE_W))
+				return -E_INVAL;
+
+	for (va = srcva; (spte = next_present(srcpgdir, &va, srcva + len)); va += PGSIZE) {
+		pp = pa2page(PTE_ADDR(*spte));
+		if (!(dpte = pgdir_walk(dstpgdir, (void *) (dstva + va - srcva), true))) {
+			r = -E_NO_MEM;
+			break;
+		}
+		pp->pp_ref++;
+		if (*dpte & PTE_P)
+			page_decref(pa2page(PTE_ADDR(*dpte)));
+		else
+			va2page_table(dstpgdir, (void *) (dstva + va - srcva))->pp_ref++;
+		*dpte = page2pa(pp) | perm | PTE_P;
+		dstpgdir[PDX(dstva + va - srcva)] |= PTE_U | PTE_W | PTE_P;
+		changed = true;
+	}
+	if (changed)
+		tlb_flush(dstpgdir);
+	return r;
+}
+
+//
+// Unmap every page mapped in [va, va+len) of pgdir, as page_remove
+// does, but flush the TLB only once.  va and len must be page-aligned.
+//
+void
+page_unmap_range(pde_t *pgdir, uintptr_t va, size_t len)
+{
+	struct PageInfo *pp, *pt;
+	uintptr_t end = va + len;
+	pte_t *pte;
+	bool changed = false;
+
+	for (; (pte = next_present(pgdir, &va, end)); va += PGSIZE) {
+		pp = pa2page(PTE_ADDR(*pte));
+		// Let futex sleepers watching a shared page see it go away.
+		if (pp->pp_ref > 1 && futex_waiting())
+			futex_wake_frame(page2pa(pp));
+		*pte = 0;
+		page_decref(pp);
+		pt = va2page_table(pgdir, (void *) va);
+		page_decref(pt);
+		if (pt->pp_ref == 0)
+			pgdir[PDX(va)] = 0;
+		changed = true;
+	}
+	if (changed)
+		tlb_flush(pgdir);
+}
+
+//
+// Set the permissions of every page mapped in [va, va+len) of pgdir to
+// 'perm|PTE_P', flushing the TLB once.  Unmapped pages are skipped.
+// va and len must be page-aligned.
+//
+// RETURNS:
+//   0 on success
+//   -E_INVAL if perm includes PTE_W and a page in the range is
+//     read-only and also mapped elsewhere, so the caller may not be
+//     allowed to write it (nothing is changed in that case)
+//
+int
+page_protect_range(pde_t *pgdir, uintptr_t va, size_t len, int perm)
+{
+	uintptr_t start = va, end = va + len;
+	pte_t *pte;
+	bool changed = false;
+
+	if (perm & PTE_W)
+		for (; (pte = next_present(pgdir, &va, end)); va += PGSIZE)
+			if (!(*pte & PTE_W) && pa2page(PTE_ADDR(*pte))->pp_ref > 1)
+				return -E_INVAL;
+
+	for (va = start; (pte = next_present(pgdir, &va, end)); va += PGSIZE) {
+		*pte = PTE_ADDR(*pte) | perm | PTE_P;
+		changed = true;
+	}
+	if (changed)
+		tlb_flush(pgdir);
+	return 0;
+}
+
 //
 // Reserve size bytes in the MMIO region and map [pa,pa+size) at this
 // location.  Return the base of the reserved region.  size does *not*
@@ -1091,6 +1259,9 @@ check_kern_pgdir(void)
 	for (i = 0; i < n; i += PGSIZE)
 		assert(check_va2pa(pgdir, UENVS + i) == PADDR(envs) + i);
 
+	// check clock page
+	assert(check_va2pa(pgdir, UCLOCK) == PADDR(clockpage));
+
 	// check phys mem
 	for (i = 0; i < npages * PGSIZE; i += PGSIZE){
 		assert(check_va2pa(pgdir, KERNBASE + i) == i);
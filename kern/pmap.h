@@ -63,6 +63,11 @@ void	page_decref(struct PageInfo *pp);
 
 void	tlb_invalidate(pde_t *pgdir, void *va);
 
+int	page_map_range(pde_t *srcpgdir, uintptr_t srcva, pde_t *dstpgdir,
+		       uintptr_t dstva, size_t len, int perm);
+void	page_unmap_range(pde_t *pgdir, uintptr_t va, size_t len);
+int	page_protect_range(pde_t *pgdir, uintptr_t va, size_t len, int perm);
+
 void *	mmio_map_region(physaddr_t pa, size_t size);
 
 int	user_mem_check(struct Env *env, const void *va, size_t len, int perm);
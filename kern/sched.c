@@ -4,6 +4,9 @@
 #include <kern/env.h>
 #include <kern/pmap.h>
 #include <kern/monitor.h>
+#include <kern/console.h>
+#include <kern/wait.h>
+#include <kern/timer.h>
 
 void sched_halt(void);
 
@@ -36,21 +39,21 @@ sched_yield(void)
 	int start_loc = 0;
 	envid_t i;
 
-	if(thiscpu->cpu_env == NULL){
+	if(curenv == NULL){
 		for(i=0; i<NENV; i++){
 			if(envs[i].env_status == ENV_RUNNABLE){
 				env_run(&envs[i]);
 			}
 		}
 	} else {
-		cur_idx = ENVX(thiscpu->cpu_env->env_id);
+		cur_idx = ENVX(curenv->env_id);
 		i = (cur_idx == NENV-1)? 0 : cur_idx + 1;
 		for(; i != cur_idx; i = ((i == NENV - 1)?0 : i+1)){
 			if(envs[i].env_status == ENV_RUNNABLE){
 				env_run(&envs[i]);
 			}
 		}
-		if(thiscpu->cpu_env->env_status == ENV_RUNNING){
+		if(curenv->env_status == ENV_RUNNING){
 			env_run(&envs[i]);
 		}
 	}
@@ -69,20 +72,23 @@ sched_halt(void)
 
 	// For debugging and testing purposes, if there are no runnable
 	// environments in the system, then drop into the kernel monitor.
+	// Environments waiting for console input will be woken by an
+	// interrupt, so in that case halt and wait for it instead;
+	// likewise for environments whose timeouts have yet to fire.
 	for (i = 0; i < NENV; i++) {
 		if ((envs[i].env_status == ENV_RUNNABLE ||
 		     envs[i].env_status == ENV_RUNNING ||
 		     envs[i].env_status == ENV_DYING))
 			break;
 	}
-	if (i == NENV) {
+	if (i == NENV && wq_empty(&cons_waitq) && !timer_pending()) {
 		cprintf("No runnable environments in the system!\n");
 		while (1)
 			monitor(NULL);
 	}
 
 	// Mark that no environment is running on this CPU
-	curenv = NULL;
+	percpu_write(cpu_env, NULL);
 	lcr3(PADDR(kern_pgdir));
 
 	// Mark that this CPU is in the HALT state, so that when
@@ -9,13 +9,21 @@
 #include <kern/spinlock.h>
 #include <kern/kdebug.h>
 
-// The big kernel lock
+// The big kernel lock.  Every CPU funnels through it on each trap,
+// so it is a fair ticket lock.
 struct spinlock kernel_lock = {
-#ifdef DEBUG_SPINLOCK
+	.type = SPIN_TICKET,
 	.name = "kernel_lock"
-#endif
 };
 
+// Registry of locks, for the 'lockstat' monitor command.
+struct spinlock *spinlocks[NSPINLOCKS] = { &kernel_lock };
+int nspinlocks = 1;
+
+// MCS queue nodes, a few per CPU so that MCS locks can nest.
+#define MCS_NNODES	4
+static struct mcs_node mcs_nodes[NCPU][MCS_NNODES];
+
 #ifdef DEBUG_SPINLOCK
 // Record the current call stack in pcs[] by following the %ebp chain.
 static void
@@ -44,13 +52,79 @@ holding(struct spinlock *lock)
 #endif
 
 void
-__spin_initlock(struct spinlock *lk, char *name)
+__spin_initlock(struct spinlock *lk, char *name, int type)
 {
+	int i;
+
 	lk->locked = 0;
-#ifdef DEBUG_SPINLOCK
+	lk->type = type;
 	lk->name = name;
+	lk->next = lk->owner = 0;
+	lk->tail = lk->node = NULL;
+#ifdef SPINLOCK_STATS
+	memset(&lk->stat, 0, sizeof(lk->stat));
+#endif
+#ifdef DEBUG_SPINLOCK
 	lk->cpu = 0;
 #endif
+
+	for (i = 0; i < nspinlocks; i++)
+		if (spinlocks[i] == lk)
+			return;
+	if (nspinlocks < NSPINLOCKS)
+		spinlocks[nspinlocks++] = lk;
+}
+
+// Acquire lk using the MCS algorithm: append this CPU's node to the
+// queue and spin on our own node until the previous holder hands
+// the lock over.  Returns true if we had to wait.
+static bool
+mcs_lock(struct spinlock *lk)
+{
+	struct mcs_node *me, *prev;
+	int i;
+
+	for (i = 0; i < MCS_NNODES; i++)
+		if (!mcs_nodes[percpu_read(cpu_id)][i].busy)
+			break;
+	if (i == MCS_NNODES)
+		panic("CPU %d: MCS locks nested too deeply at %s",
+		      cpunum(), lk->name);
+	me = &mcs_nodes[percpu_read(cpu_id)][i];
+	me->busy = 1;
+	me->next = NULL;
+	me->locked = 1;
+
+	prev = (struct mcs_node *) xchg((volatile uint32_t *) &lk->tail,
+					(uint32_t) me);
+	if (prev) {
+		prev->next = me;
+		while (me->locked)
+			asm volatile ("pause");
+	}
+	lk->node = me;
+	return prev != NULL;
+}
+
+static void
+mcs_unlock(struct spinlock *lk)
+{
+	struct mcs_node *me = lk->node;
+
+	lk->node = NULL;
+	if (!me->next) {
+		// No known successor: try to swing the tail back to empty.
+		if (cmpxchg((volatile uint32_t *) &lk->tail,
+			    (uint32_t) me, 0) == (uint32_t) me) {
+			me->busy = 0;
+			return;
+		}
+		// Someone is enqueueing; wait for them to link in.
+		while (!me->next)
+			asm volatile ("pause");
+	}
+	me->next->locked = 0;
+	me->busy = 0;
 }
 
 // Acquire the lock.
@@ -65,11 +139,48 @@ spin_lock(struct spinlock *lk)
 		panic("CPU %d cannot acquire %s: already holding", cpunum(), lk->name);
 #endif
 
-	// The xchg is atomic.
-	// It also serializes, so that reads after acquire are not
-	// reordered before it. 
-	while (xchg(&lk->locked, 1) != 0)
-		asm volatile ("pause");
+#ifdef SPINLOCK_STATS
+	uint64_t start = read_tsc();
+#endif
+	bool contended;
+	uint32_t ticket;
+
+	switch (lk->type) {
+	case SPIN_TICKET:
+		// Take a ticket and wait for it to be served.
+		// xadd is a locked instruction, so it also serializes.
+		ticket = xadd(&lk->next, 1);
+		contended = (lk->owner != ticket);
+		while (lk->owner != ticket)
+			asm volatile ("pause");
+		lk->locked = 1;
+		break;
+
+	case SPIN_MCS:
+		contended = mcs_lock(lk);
+		lk->locked = 1;
+		break;
+
+	default:
+		// The xchg is atomic.
+		// It also serializes, so that reads after acquire are not
+		// reordered before it.
+		contended = false;
+		while (xchg(&lk->locked, 1) != 0) {
+			contended = true;
+			asm volatile ("pause");
+		}
+		break;
+	}
+
+#ifdef SPINLOCK_STATS
+	lk->stat.hold_start = read_tsc();
+	lk->stat.acquires++;
+	if (contended) {
+		lk->stat.contended++;
+		lk->stat.spin_cycles += lk->stat.hold_start - start;
+	}
+#endif
 
 	// Record info about lock acquisition for debugging.
 #ifdef DEBUG_SPINLOCK
@@ -107,6 +218,27 @@ spin_unlock(struct spinlock *lk)
 	lk->cpu = 0;
 #endif
 
+#ifdef SPINLOCK_STATS
+	uint64_t held = read_tsc() - lk->stat.hold_start;
+	if (held > lk->stat.max_hold)
+		lk->stat.max_hold = held;
+#endif
+
+	if (lk->type == SPIN_TICKET) {
+		// Only the holder writes owner, so a plain increment
+		// suffices; the asm keeps gcc from hoisting it.
+		lk->locked = 0;
+		asm volatile("" : : : "memory");
+		lk->owner++;
+		return;
+	}
+	if (lk->type == SPIN_MCS) {
+		lk->locked = 0;
+		asm volatile("" : : : "memory");
+		mcs_unlock(lk);
+		return;
+	}
+
 	// The xchg instruction is atomic (i.e. uses the "lock" prefix) with
 	// respect to any other instruction which references the same memory.
 	// x86 CPUs will not reorder loads/stores across locked instructions
@@ -4,26 +4,80 @@
 #include <inc/types.h>
 
 // Comment this to disable spinlock debugging
+// (release builds never include it).
+#ifndef JOS_RELEASE
 #define DEBUG_SPINLOCK
+#endif
+
+// Comment this to disable per-lock contention statistics
+// (reported by the 'lockstat' monitor command; release builds never
+// keep them).
+#ifndef JOS_RELEASE
+#define SPINLOCK_STATS
+#endif
+
+// Lock algorithms.  A lock's type is chosen when it is initialized;
+// a zero-initialized lock is a plain test-and-set lock.
+enum {
+	SPIN_TAS = 0,		// xchg loop; cheap but unfair
+	SPIN_TICKET,		// FIFO ticket lock
+	SPIN_MCS,		// FIFO queue lock; each waiter spins locally
+};
+
+// An MCS queue node.  Every CPU owns a few of these (see spinlock.c),
+// so locks of type SPIN_MCS can be nested a few levels deep.
+struct mcs_node {
+	struct mcs_node *volatile next;
+	volatile uint32_t locked;
+	uint32_t busy;		// Node is in use by this CPU
+};
+
+// Contention statistics.  All times are in TSC cycles.
+struct spinlock_stat {
+	uint64_t acquires;	// Number of acquisitions
+	uint64_t contended;	// Acquisitions that had to wait
+	uint64_t spin_cycles;	// Total time spent waiting
+	uint64_t max_hold;	// Longest time the lock was held
+	uint64_t hold_start;	// When the current holder acquired it
+};
 
 // Mutual exclusion lock.
 struct spinlock {
 	unsigned locked;       // Is the lock held?
+	int type;              // SPIN_TAS, SPIN_TICKET or SPIN_MCS
+	char *name;            // Name of lock.
+
+	// SPIN_TICKET: next ticket to hand out and ticket now served.
+	volatile uint32_t next;
+	volatile uint32_t owner;
+
+	// SPIN_MCS: last waiter in the queue and the holder's node.
+	struct mcs_node *volatile tail;
+	struct mcs_node *node;
+
+#ifdef SPINLOCK_STATS
+	struct spinlock_stat stat;
+#endif
 
 #ifdef DEBUG_SPINLOCK
 	// For debugging:
-	char *name;            // Name of lock.
 	struct CpuInfo *cpu;   // The CPU holding the lock.
 	uintptr_t pcs[10];     // The call stack (an array of program counters)
 	                       // that locked the lock.
 #endif
 };
 
-void __spin_initlock(struct spinlock *lk, char *name);
+void __spin_initlock(struct spinlock *lk, char *name, int type);
 void spin_lock(struct spinlock *lk);
 void spin_unlock(struct spinlock *lk);
 
-#define spin_initlock(lock)   __spin_initlock(lock, #lock)
+#define spin_initlock(lock)   __spin_initlock(lock, #lock, SPIN_TAS)
+#define spin_initlock_type(lock, type)   __spin_initlock(lock, #lock, type)
+
+// Locks known to the 'lockstat' monitor command.
+#define NSPINLOCKS	32
+extern struct spinlock *spinlocks[NSPINLOCKS];
+extern int nspinlocks;
 
 extern struct spinlock kernel_lock;
 
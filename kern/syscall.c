@@ -11,11 +11,20 @@
 #include <kern/syscall.h>
 #include <kern/console.h>
 #include <kern/sched.h>
+#include <kern/wait.h>
+#include <kern/futex.h>
+
+// Environments blocked in sys_ipc_recv.
+static struct WaitQueue ipc_recv_waitq;
+
+// Environments blocked in sys_wait_notify.
+static struct WaitQueue notify_waitq;
+static struct WaitQueue sleep_waitq;
 
 // Print a string to the system console.
 // The string is exactly 'len' characters long.
-// Destroys the environment on memory errors.
-static void
+// Destroys the environment on memory errors.  Returns 0.
+static int
 sys_cputs(const char *s, size_t len)
 {
 	// Check that the user has permission to read memory [s, s+len).
@@ -26,6 +35,7 @@ sys_cputs(const char *s, size_t len)
 
 	// Print the string supplied by the user.
 	cprintf("%.*s", len, s);
+	return 0;
 }
 
 // Read a character from the system console without blocking.
@@ -114,6 +124,8 @@ sys_env_set_status(envid_t envid, int status)
 	struct Env *e;
 	int r = envid2env(envid, &e, 1);
 	if(r < 0) return r;
+	// An env blocked in the kernel is woken only by its wait queue.
+	if (e->env_waitq) return -E_INVAL;
 	e->env_status = status;
 	return 0;
 }
@@ -266,10 +278,10 @@ sys_page_map(envid_t srcenvid, void *srcva,
 	struct PageInfo *page;
 	pte_t *pte;
 	page = page_lookup(e_src->env_pgdir, srcva, &pte);
+	if(page == NULL) return -E_INVAL;
 	if((*pte & PTE_W)==0 && (perm &  PTE_W)!=0){
 		return -E_INVAL;
 	}
-	if(page == NULL) return -E_INVAL;
 	r = page_insert(e_dst->env_pgdir, page, dstva, perm);
 	if(r < 0) return r;
 	return 0;
@@ -293,10 +305,252 @@ sys_page_unmap(envid_t envid, void *va)
 	if(r < 0) return -E_BAD_ENV;
 	if((uint32_t)va >= UTOP) return -E_INVAL;
 	if(ROUNDDOWN(va, PGSIZE) != va) return -E_INVAL;
+	// Let futex sleepers watching a shared page see it go away.
+	pte_t *pte;
+	struct PageInfo *pp = page_lookup(e->env_pgdir, va, &pte);
+	if (pp && (*pte & PTE_P) && pp->pp_ref > 1 && futex_waiting())
+		futex_wake_frame(page2pa(pp));
 	page_remove(e->env_pgdir, va);
 	return 0;
 }
 
+// Is [va, va+len) a page-aligned range of user addresses?
+static bool
+user_range_ok(uintptr_t va, size_t len)
+{
+	return !PGOFF(va) && !PGOFF(len) && va < UTOP && len <= UTOP - va;
+}
+
+// Check perm as sys_page_alloc does.
+static bool
+user_perm_ok(int perm)
+{
+	return (perm & (PTE_U|PTE_P)) == (PTE_U|PTE_P)
+		&& (perm | PTE_SYSCALL) == PTE_SYSCALL;
+}
+
+// Map every page mapped in [srcva, srcva+len) of srcenvid's address
+// space at the same offset from dstva in dstenvid's, as a series of
+// sys_page_map calls would, but with a single TLB flush.  Unmapped
+// source pages are skipped.  len must be page-aligned; since a system
+// call has only five arguments, perm is passed in its low 12 bits.
+//
+// Return 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if srcenvid and/or dstenvid doesn't currently exist,
+//		or the caller doesn't have permission to change one of them.
+//	-E_INVAL if either range is not page-aligned or extends above UTOP,
+//		or the ranges overlap in the same address space.
+//	-E_INVAL if perm is inappropriate (see sys_page_alloc).
+//	-E_INVAL if (perm & PTE_W), but a source page is read-only.
+//	-E_NO_MEM if there's no memory to allocate any necessary page tables.
+static int
+sys_page_map_range(envid_t srcenvid, uintptr_t srcva,
+		   envid_t dstenvid, uintptr_t dstva, uint32_t len_perm)
+{
+	struct Env *src, *dst;
+	size_t len = ROUNDDOWN(len_perm, PGSIZE);
+	int perm = PGOFF(len_perm);
+
+	if (envid2env(srcenvid, &src, 1) < 0 || envid2env(dstenvid, &dst, 1) < 0)
+		return -E_BAD_ENV;
+	if (!user_range_ok(srcva, len) || !user_range_ok(dstva, len))
+		return -E_INVAL;
+	if (!user_perm_ok(perm))
+		return -E_INVAL;
+	if (src->env_pgdir == dst->env_pgdir && srcva != dstva
+	    && srcva < dstva + len && dstva < srcva + len)
+		return -E_INVAL;
+	return page_map_range(src->env_pgdir, srcva, dst->env_pgdir, dstva,
+			      len, perm);
+}
+
+// Unmap every page in [va, va+len) of envid's address space, with a
+// single TLB flush.  Unmapped pages are skipped.
+//
+// Return 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist,
+//		or the caller doesn't have permission to change envid.
+//	-E_INVAL if the range is not page-aligned or extends above UTOP.
+static int
+sys_page_unmap_range(envid_t envid, uintptr_t va, size_t len)
+{
+	struct Env *e;
+
+	if (envid2env(envid, &e, 1) < 0)
+		return -E_BAD_ENV;
+	if (!user_range_ok(va, len))
+		return -E_INVAL;
+	page_unmap_range(e->env_pgdir, va, len);
+	return 0;
+}
+
+// Change the permissions of every page mapped in [va, va+len) of
+// envid's address space to 'perm', with a single TLB flush.
+// Unmapped pages are skipped.
+//
+// Return 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist,
+//		or the caller doesn't have permission to change envid.
+//	-E_INVAL if the range is not page-aligned or extends above UTOP.
+//	-E_INVAL if perm is inappropriate (see sys_page_alloc).
+//	-E_INVAL if (perm & PTE_W), but a read-only page in the range is
+//		also mapped elsewhere.
+static int
+sys_page_protect_range(envid_t envid, uintptr_t va, size_t len, int perm)
+{
+	struct Env *e;
+
+	if (envid2env(envid, &e, 1) < 0)
+		return -E_BAD_ENV;
+	if (!user_range_ok(va, len) || !user_perm_ok(perm))
+		return -E_INVAL;
+	return page_protect_range(e->env_pgdir, va, len, perm);
+}
+
+// Check an IPC range of 'npages' pages at 'va' (see IPC_SENDPAGES in
+// inc/env.h).  A range starting below UTOP must be page-aligned and
+// end below UTOP too.
+static int
+ipc_range_ok(void *va, int npages)
+{
+	if ((uintptr_t) va >= UTOP)
+		return 0;
+	if (PGOFF(va) || npages > (UTOP - (uintptr_t) va) / PGSIZE)
+		return -E_INVAL;
+	return 0;
+}
+
+// Check that env e may send the pages in range srcva with
+// permissions perm: every page must be mapped, and writable if
+// perm includes PTE_W.
+static int
+ipc_check_range(struct Env *e, void *srcva, unsigned perm)
+{
+	struct PageInfo *pp;
+	uintptr_t va = (uintptr_t) srcva;
+	pte_t *pte;
+	int i, n = IPC_NSEND(perm), r;
+
+	if ((r = ipc_range_ok(srcva, n)) < 0)
+		return r;
+	perm = IPC_PGPERM(perm);
+	// check perm
+	if((perm & PTE_U)==0 || (perm & PTE_P)==0) return -E_INVAL;
+	if((perm | PTE_SYSCALL) != PTE_SYSCALL) return -E_INVAL;
+	// check send env address space
+	for (i = 0; i < n; i++, va += PGSIZE) {
+		pp = page_lookup(e->env_pgdir, (void *) va, &pte);
+		if (pp == NULL || (*pte & PTE_P) == 0) return -E_INVAL;
+		if ((*pte & PTE_W) == 0 && (perm & PTE_W)) return -E_INVAL;
+	}
+	return 0;
+}
+
+// Deliver a message from src to dst, which must be receiving.
+// Maps as many of the sent pages as fit in dst's window.
+// Updates dst's ipc fields but does not wake it.
+static int
+ipc_deliver(struct Env *src, struct Env *dst, uint32_t value,
+	    void *srcva, unsigned perm)
+{
+	struct PageInfo *pp;
+	uintptr_t va = (uintptr_t) srcva, dstva;
+	int i, n = IPC_NSEND(perm), r;
+
+	dst->env_ipc_perm = 0;
+	dst->env_ipc_npages = 0;
+	if ((uintptr_t) srcva < UTOP) {
+		if ((r = ipc_check_range(src, srcva, perm)) < 0)
+			return r;
+		perm = IPC_PGPERM(perm);
+		dstva = (uintptr_t) dst->env_ipc_dstva;
+		if (dstva < UTOP) {
+			n = MIN(n, dst->env_ipc_dstpages);
+			for (i = 0; i < n; i++) {
+				pp = page_lookup(src->env_pgdir,
+						 (void *) (va + i * PGSIZE), NULL);
+				r = page_insert(dst->env_pgdir, pp,
+						(void *) (dstva + i * PGSIZE), perm);
+				if (r < 0) return -E_NO_MEM;
+			}
+			dst->env_ipc_perm = perm;
+			dst->env_ipc_npages = n;
+		}
+	}
+	dst->env_ipc_from = src->env_id;
+	dst->env_ipc_value = value;
+	dst->env_ipc_recving = false;
+	// A caller answered while still queued to send its request gives
+	// up the request: it must not look like a caller when it next
+	// sends.
+	dst->env_ipc_calling = false;
+	if (dst->env_ipc_regs) {
+		// sys_ipc_call and sys_ipc_reply_wait also return the
+		// message in registers, saving a look at struct Env.
+		dst->env_tf.tf_regs.reg_edx = value;
+		dst->env_tf.tf_regs.reg_ecx = src->env_id;
+		dst->env_tf.tf_regs.reg_ebx = dst->env_ipc_perm;
+	}
+	return 0;
+}
+
+// Would dst accept a message from src right now?
+static bool
+ipc_accepts(struct Env *dst, struct Env *src)
+{
+	return dst->env_ipc_recving
+		&& (!dst->env_ipc_waitfrom || dst->env_ipc_waitfrom == src->env_id);
+}
+
+// Put e into the receiving state, accepting up to 'npages' pages at
+// dstva.  If 'from' is nonzero, e only accepts a message from that
+// environment.  'regs' says whether the message should also be
+// returned in registers.
+static int
+ipc_recv_setup(struct Env *e, void *dstva, int npages, envid_t from,
+	       bool regs)
+{
+	if (ipc_range_ok(dstva, npages) < 0) return -E_INVAL;
+	e->env_ipc_dstva = (uintptr_t) dstva < UTOP ? dstva : (void *)~0;
+	e->env_ipc_dstpages = npages;
+	e->env_ipc_recving = true;
+	e->env_ipc_from = 0;
+	e->env_ipc_waitfrom = from;
+	e->env_ipc_regs = regs;
+	return 0;
+}
+
+// Take the message of the oldest sender blocked on curenv, which must
+// be receiving.  A sender in sys_ipc_call goes on to wait for our
+// reply; other senders are woken with the result of the delivery.
+// Returns 0 if a message was received, -E_IPC_NOT_RECV if nobody was
+// waiting.
+static int
+ipc_take_sender(void)
+{
+	struct Env *sender;
+	int r;
+
+	while ((sender = curenv->env_ipc_senders.wq_head) != NULL) {
+		r = ipc_deliver(sender, curenv, sender->env_ipc_send_value,
+				sender->env_ipc_send_srcva,
+				sender->env_ipc_send_perm);
+		if (sender->env_ipc_calling) {
+			sender->env_ipc_calling = false;
+			if (r == 0) {
+				wq_remove(sender);
+				wq_enqueue(&ipc_recv_waitq, sender);
+				return 0;
+			}
+			sender->env_ipc_recving = false;
+		}
+		wq_wakeup_env(sender, r);
+		if (r == 0)
+			return 0;
+	}
+	return -E_IPC_NOT_RECV;
+}
+
 // Try to send 'value' to the target env 'envid'.
 // If srcva < UTOP, then also send page currently mapped at 'srcva',
 // so that receiver gets a duplicate mapping of the same page.
@@ -318,6 +572,10 @@ sys_page_unmap(envid_t envid, void *va)
 //
 // If the sender wants to send a page but the receiver isn't asking for one,
 // then no page mapping is transferred, but no error occurs.
+//
+// perm may ask for a run of pages at srcva (see IPC_SENDPAGES in
+// inc/env.h); the receiver gets as many of them as fit its window, and
+// env_ipc_npages is set to the number of pages mapped.
 // The ipc only happens when no errors occur.
 //
 // Returns 0 on success, < 0 on error.
@@ -326,7 +584,8 @@ sys_page_unmap(envid_t envid, void *va)
 //		(No need to check permissions.)
 //	-E_IPC_NOT_RECV if envid is not currently blocked in sys_ipc_recv,
 //		or another environment managed to send first.
-//	-E_INVAL if srcva < UTOP but srcva is not page-aligned.
+//	-E_INVAL if srcva < UTOP but is not page-aligned, or the range
+//		it starts extends past UTOP.
 //	-E_INVAL if srcva < UTOP and perm is inappropriate
 //		(see sys_page_alloc).
 //	-E_INVAL if srcva < UTOP but srcva is not mapped in the caller's
@@ -341,38 +600,49 @@ sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
 	// LAB 4: Your code here.
 	struct Env *recv_env ;
 	int r;
+	curenv->env_ipc_calling = false;
 	r = envid2env(envid, &recv_env, 0);
 	if (r < 0) return -E_BAD_ENV;
-	if (! recv_env->env_ipc_recving) return -E_IPC_NOT_RECV;
-	if((uint32_t)srcva < UTOP && srcva != ROUNDDOWN(srcva, PGSIZE)) return -E_INVAL;
-
-	if ((uint32_t)srcva < UTOP){
-		// check perm
-		if((perm & PTE_U)==0 || (perm & PTE_P)==0) return -E_INVAL;
-		if((perm | PTE_SYSCALL) != PTE_SYSCALL) return -E_INVAL;
-
-		// check send env address space
-		pte_t *pte_entry; 
-		struct PageInfo *pp;
-		pp = page_lookup(curenv->env_pgdir, srcva, &pte_entry);
-		if(pte_entry == NULL) return -E_INVAL;
-		if(((*pte_entry) & PTE_P) == 0) return -E_INVAL;
-		if(((*pte_entry) & PTE_W) == 0 && ((perm & PTE_W) == PTE_W)) return -E_INVAL;
-
-		if((uint32_t)recv_env->env_ipc_dstva < UTOP){
-			r = page_insert(recv_env->env_pgdir, pp, recv_env->env_ipc_dstva, perm);
-			if (r < 0) return -E_NO_MEM;
-			recv_env->env_ipc_perm = perm;
-		}
+	if (! ipc_accepts(recv_env, curenv)) return -E_IPC_NOT_RECV;
+	if ((r = ipc_deliver(curenv, recv_env, value, srcva, perm)) < 0)
+		return r;
+	wq_wakeup_env(recv_env, 0);
+	return 0;
+}
+
+// Like sys_ipc_try_send, but if the target is not receiving, block
+// until it is.  Blocked senders queue up on the target in FIFO order,
+// and each sys_ipc_recv takes the oldest one.
+//
+// The page transfer is checked before blocking, so errors in the
+// arguments are reported immediately.  Returns 0 once the message has
+// been delivered, or < 0 on error, including -E_BAD_ENV if the target
+// exits while we wait.
+static int
+sys_ipc_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
+{
+	struct Env *recv_env;
+	int r;
+
+	if (envid2env(envid, &recv_env, 0) < 0)
+		return -E_BAD_ENV;
+	if ((uintptr_t) srcva < UTOP
+	    && (r = ipc_check_range(curenv, srcva, perm)) < 0)
+		return r;
+	if (ipc_accepts(recv_env, curenv)) {
+		if ((r = ipc_deliver(curenv, recv_env, value, srcva, perm)) < 0)
+			return r;
+		wq_wakeup_env(recv_env, 0);
+		return 0;
 	}
+	if (recv_env == curenv)
+		return -E_INVAL;
 
-	// recv_env->env_ipc_perm = 0;
-	recv_env->env_ipc_from = curenv->env_id;
-	recv_env->env_ipc_value = value;
-	recv_env->env_ipc_recving = false;
-	recv_env->env_status = ENV_RUNNABLE;
-	recv_env->env_tf.tf_regs.reg_eax = 0;
-	return 0;
+	curenv->env_ipc_send_value = value;
+	curenv->env_ipc_send_srcva = srcva;
+	curenv->env_ipc_send_perm = perm;
+	curenv->env_ipc_calling = false;
+	wq_sleep(&recv_env->env_ipc_senders);
 }
 
 // Block until a value is ready.  Record that you want to receive
@@ -382,6 +652,9 @@ sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
 // If 'dstva' is < UTOP, then you are willing to receive a page of data.
 // 'dstva' is the virtual address at which the sent page should be mapped.
 //
+// If senders are already blocked in sys_ipc_send waiting for us, take
+// the oldest one's message and return right away.
+//
 // This function only returns on error, but the system call will eventually
 // return 0 on success.
 // Return < 0 on error.  Errors are:
@@ -390,20 +663,251 @@ static int
 sys_ipc_recv(void *dstva)
 {
 	// LAB 4: Your code here.
-	if ((uint32_t)dstva < UTOP && dstva != ROUNDDOWN(dstva, PGSIZE)) return -E_INVAL;
-	
-	if((uint32_t)dstva < UTOP) 
-		{curenv->env_ipc_dstva = dstva;}
-	else
-		{curenv->env_ipc_dstva = (void *)~0;}
-	
-	curenv->env_status = ENV_NOT_RUNNABLE;
-	curenv->env_ipc_recving = true;
-	curenv->env_ipc_from = 0;
+	int r;
+
+	if ((r = ipc_recv_setup(curenv, dstva, 1, 0, false)) < 0)
+		return r;
+	if (ipc_take_sender() == 0)
+		return 0;
+	wq_sleep(&ipc_recv_waitq);
+}
+
+// Send a request to 'envid' and wait for its reply, in one system call.
+// The request is sent as with sys_ipc_send; then we receive as with
+// sys_ipc_recv into 'dstva', accepting a message only from 'envid'.
+// The reply may carry up to IPC_NRECV(perm) pages.
+// If the server is already waiting, the CPU switches straight to it.
+//
+// On success the system call returns 0 with the reply's value, sender
+// and page permissions in %edx, %ecx and %ebx (as well as in the
+// env_ipc_* fields).  Returns < 0 on error, including -E_BAD_ENV if
+// the server exits before replying.
+static int
+sys_ipc_call(envid_t envid, uint32_t value, void *srcva, unsigned perm,
+	     void *dstva)
+{
+	struct Env *srv;
+	int r;
+
+	if (envid2env(envid, &srv, 0) < 0)
+		return -E_BAD_ENV;
+	if (srv == curenv)
+		return -E_INVAL;
+	if ((uintptr_t) srcva < UTOP
+	    && (r = ipc_check_range(curenv, srcva, perm)) < 0)
+		return r;
+	if ((r = ipc_recv_setup(curenv, dstva, IPC_NRECV(perm), srv->env_id,
+				true)) < 0)
+		return r;
+
+	if (ipc_accepts(srv, curenv)) {
+		if ((r = ipc_deliver(curenv, srv, value, srcva, perm)) < 0) {
+			curenv->env_ipc_recving = false;
+			return r;
+		}
+		wq_wakeup_env(srv, 0);
+		wq_enqueue(&ipc_recv_waitq, curenv);
+		env_run(srv);
+	}
+
+	curenv->env_ipc_send_value = value;
+	curenv->env_ipc_send_srcva = srcva;
+	curenv->env_ipc_send_perm = perm;
+	curenv->env_ipc_calling = true;
+	wq_sleep(&srv->env_ipc_senders);
+}
+
+// Reply to a client blocked in sys_ipc_call and wait for the next
+// request, in one system call.  If 'envid' is 0, just wait.
+// If no request is pending, the CPU switches straight to the client.
+//
+// The reply fails with -E_IPC_NOT_RECV if the client is not waiting
+// for a reply from us, and -E_BAD_ENV if it no longer exists; in either
+// case we do not go on to wait.  Otherwise returns as sys_ipc_call.
+// As there, perm gives the pages of the reply at srcva and the most
+// pages the request may bring to dstva.
+static int
+sys_ipc_reply_wait(envid_t envid, uint32_t value, void *srcva, unsigned perm,
+		   void *dstva)
+{
+	struct Env *cli = NULL;
+	int r;
+
+	if (ipc_range_ok(dstva, IPC_NRECV(perm)) < 0)
+		return -E_INVAL;
+	if (envid) {
+		if (envid2env(envid, &cli, 0) < 0)
+			return -E_BAD_ENV;
+		if (cli == curenv || !ipc_accepts(cli, curenv))
+			return -E_IPC_NOT_RECV;
+		if ((r = ipc_deliver(curenv, cli, value, srcva, perm)) < 0)
+			return r;
+		wq_wakeup_env(cli, 0);
+	}
+
+	ipc_recv_setup(curenv, dstva, IPC_NRECV(perm), 0, true);
+	if (ipc_take_sender() == 0)
+		return 0;
+	wq_enqueue(&ipc_recv_waitq, curenv);
+	if (cli)
+		env_run(cli);
 	sched_yield();
+}
+
+// Clean up the IPC state of environment e, which is being freed:
+// fail its queued senders, and any callers still waiting for its reply.
+void
+ipc_env_free(struct Env *e)
+{
+	struct Env *w, *next;
+
+	while ((w = e->env_ipc_senders.wq_head) != NULL) {
+		if (w->env_ipc_calling) {
+			w->env_ipc_calling = false;
+			w->env_ipc_recving = false;
+		}
+		wq_wakeup_env(w, -E_BAD_ENV);
+	}
+	for (w = ipc_recv_waitq.wq_head; w; w = next) {
+		next = w->env_wait_next;
+		if (w->env_ipc_waitfrom == e->env_id) {
+			w->env_ipc_recving = false;
+			wq_wakeup_env(w, -E_BAD_ENV);
+		}
+	}
+}
+
+// Block until environment 'envid' has exited.
+// Returns 0 immediately if there is no such environment.
+static int
+sys_env_wait(envid_t envid)
+{
+	struct Env *e;
+
+	if (envid2env(envid, &e, 0) < 0 || e->env_status == ENV_FREE)
+		return 0;
+	if (e == curenv)
+		return -E_INVAL;
+	wq_sleep(&e->env_exitq);
+}
+
+// Read a character from the system console, sleeping until one is
+// available.  Returns the character.
+static int
+sys_cgetc_wait(void)
+{
+	int c;
+
+	if ((c = cons_getc()) != 0)
+		return c;
+	wq_sleep(&cons_waitq);
+}
+
+// Post notification bits to environment e, waking it if it is
+// waiting for any of them.  Never blocks; may be called from
+// interrupt handlers as well as system calls.
+void
+env_notify(struct Env *e, uint32_t bits)
+{
+	uint32_t got;
+
+	e->env_notify |= bits;
+	if (e->env_waitq == &notify_waitq
+	    && (got = e->env_notify & e->env_notify_mask) != 0) {
+		e->env_notify &= ~got;
+		e->env_notify_mask = 0;
+		wq_wakeup_env(e, got);
+	}
+}
+
+// OR 'bits' into the notification word of environment 'envid'.
+// Unlike IPC, this never blocks and never fails because the target
+// is busy; bits posted while nobody waits stay pending.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist.
+//	-E_INVAL if bits has bits outside NOTIFY_BITS.
+static int
+sys_notify(envid_t envid, uint32_t bits)
+{
+	struct Env *e;
+
+	if (envid2env(envid, &e, 0) < 0)
+		return -E_BAD_ENV;
+	if (bits & ~NOTIFY_BITS)
+		return -E_INVAL;
+	env_notify(e, bits);
 	return 0;
 }
 
+// Wait until any of the notification bits in 'mask' is pending.
+// Clears those pending bits that are in 'mask' and returns them.
+// Returns 0 at once if 'mask' is 0.
+// Returns < 0 on error.  Errors are:
+//	-E_INVAL if mask has bits outside NOTIFY_BITS.
+//	-E_TIMEOUT if a timeout set by sys_set_timeout expires first.
+static int
+sys_wait_notify(uint32_t mask)
+{
+	uint32_t got;
+
+	if (mask & ~NOTIFY_BITS)
+		return -E_INVAL;
+	if ((got = curenv->env_notify & mask) != 0 || mask == 0) {
+		curenv->env_notify &= ~got;
+		return got;
+	}
+	curenv->env_notify_mask = mask;
+	wq_sleep(&notify_waitq);
+}
+
+// Sleep for 'nsec' nanoseconds (passed as two halves), rounded up to
+// the next timer tick.  A sleep of 0 just yields the CPU.
+// Returns 0.
+static int
+sys_sleep(uint32_t nsec_lo, uint32_t nsec_hi)
+{
+	uint64_t nsec = (uint64_t) nsec_hi << 32 | nsec_lo;
+
+	if (nsec == 0) {
+		curenv->env_tf.tf_regs.reg_eax = 0;
+		sys_yield();
+	}
+	curenv->env_wait_timeout = nsec;
+	wq_sleep(&sleep_waitq);
+}
+
+// Give the next system call a timeout of 'nsec' nanoseconds (passed
+// as two halves).  If that call blocks for longer, it gives up and
+// fails with -E_TIMEOUT, undoing any wait it set up; a timeout of 0
+// gives up at the next timer tick.  Any blocking call may be timed
+// out this way.  The timeout is dropped by the next call whether or
+// not it blocks.
+// Returns 0.
+static int
+sys_set_timeout(uint32_t nsec_lo, uint32_t nsec_hi)
+{
+	uint64_t nsec = (uint64_t) nsec_hi << 32 | nsec_lo;
+
+	// env_next_timeout is 0 when there is no timeout.
+	curenv->env_next_timeout = MAX(nsec, 1);
+	return 0;
+}
+
+// The timer of e, which is blocked, has fired: end its wait.
+// sys_sleep returns 0; any other call fails with -E_TIMEOUT, and
+// stops receiving, sending or waiting for notifications.
+void
+env_wait_expired(struct Env *e)
+{
+	int32_t ret = e->env_waitq == &sleep_waitq ? 0 : -E_TIMEOUT;
+
+	e->env_ipc_recving = false;
+	e->env_ipc_calling = false;
+	e->env_notify_mask = 0;
+	wq_wakeup_env(e, ret);
+}
+
 // print pgdir info, include pte, pde, perm
 static int
 sys_print_pgdir_va_info(pde_t *pgdir, void * va){
@@ -443,77 +947,110 @@ sys_print_pgdir_va_info(pde_t *pgdir, void * va){
 }
 
 
-// Dispatches to the correct kernel function, passing the arguments.
-int32_t
-syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5)
-{
-	// Call the function corresponding to the 'syscallno' parameter.
-	// Return any appropriate return value.
-	// LAB 3: Your code here.
+static int sys_batch(void);
 
-	// panic("syscall not implemented");
+// System call handlers, indexed by system call number.  Handlers take
+// between zero and five 32-bit arguments; i386 callers pop their own
+// arguments, so calling one with all five through this type is safe.
+typedef int32_t (*syscall_fn)(uint32_t, uint32_t, uint32_t, uint32_t, uint32_t);
 
+static const syscall_fn syscalls[NSYSCALLS] = {
+	[SYS_cputs] =			(syscall_fn) sys_cputs,
+	[SYS_cgetc] =			(syscall_fn) sys_cgetc,
+	[SYS_getenvid] =		(syscall_fn) sys_getenvid,
+	[SYS_env_destroy] =		(syscall_fn) sys_env_destroy,
+	[SYS_page_alloc] =		(syscall_fn) sys_page_alloc,
+	[SYS_page_map] =		(syscall_fn) sys_page_map,
+	[SYS_page_unmap] =		(syscall_fn) sys_page_unmap,
+	[SYS_exofork] =			(syscall_fn) sys_exofork,
+	[SYS_env_set_status] =		(syscall_fn) sys_env_set_status,
+	[SYS_env_set_trapframe] =	(syscall_fn) sys_env_set_trapframe,
+	[SYS_env_set_pgfault_upcall] =	(syscall_fn) sys_env_set_pgfault_upcall,
+	[SYS_yield] =			(syscall_fn) sys_yield,
+	[SYS_ipc_try_send] =		(syscall_fn) sys_ipc_try_send,
+	[SYS_ipc_recv] =		(syscall_fn) sys_ipc_recv,
+	[SYS_print_pgdir_va_info] =	(syscall_fn) sys_print_pgdir_va_info,
+	[SYS_env_wait] =		(syscall_fn) sys_env_wait,
+	[SYS_cgetc_wait] =		(syscall_fn) sys_cgetc_wait,
+	[SYS_futex_wait] =		(syscall_fn) futex_wait,
+	[SYS_futex_wake] =		(syscall_fn) futex_wake,
+	[SYS_ipc_send] =		(syscall_fn) sys_ipc_send,
+	[SYS_ipc_call] =		(syscall_fn) sys_ipc_call,
+	[SYS_ipc_reply_wait] =		(syscall_fn) sys_ipc_reply_wait,
+	[SYS_notify] =			(syscall_fn) sys_notify,
+	[SYS_wait_notify] =		(syscall_fn) sys_wait_notify,
+	[SYS_batch] =			(syscall_fn) sys_batch,
+	[SYS_page_map_range] =		(syscall_fn) sys_page_map_range,
+	[SYS_page_unmap_range] =	(syscall_fn) sys_page_unmap_range,
+	[SYS_page_protect_range] =	(syscall_fn) sys_page_protect_range,
+	[SYS_sleep] =			(syscall_fn) sys_sleep,
+	[SYS_set_timeout] =		(syscall_fn) sys_set_timeout,
+};
 
-	int32_t result;
-	int print_flag = 0;
-	if(print_flag){
-		cprintf("syscall num %d\n", syscallno);
-	}
-	switch (syscallno) {
-		case SYS_cputs:
-			sys_cputs((char *)a1, (size_t) a2);
-			result = 0;
-			break;
-		case SYS_cgetc:
-			// cprintf("syscall: sys_cgetc\n");
-			result = sys_cgetc();
-			break;
-		case SYS_getenvid:
-			// cprintf("syscall: sys_getenvid\n");
-			result = sys_getenvid();
-			break;
-		case SYS_env_destroy:
-			// cprintf("syscall: sys_env_destroy\n");
-			result = sys_env_destroy((envid_t)a1);
-			break;
-		case SYS_yield:
-			// cprintf("syscall: sys_yield\n");
-			sys_yield();
-			result = 0;
-			break;
-		case SYS_exofork:
-			// cprintf("syscall: sys_exofork\n");
-			result = sys_exofork();
-			break;
-		case SYS_page_alloc:
-			// cprintf("syscall: sys_page_alloc\n");
-			result = sys_page_alloc((envid_t) a1, (void *) a2, (int)a3);
-			break;
-		case SYS_page_map:
-			// cprintf("syscall: sys_page_map\n");
-			result = sys_page_map((envid_t)a1, (void*)a2, (envid_t)a3, (void*)a4, (int)a5);
-			break;
-		case SYS_page_unmap:
-			// cprintf("syscall: sys_page_unmap\n");
-			result = sys_page_unmap((envid_t)a1, (void*)a2);
-			break;
-		case SYS_env_set_status:
-			// cprintf("syscall: sys_env_set_status\n");
-			return sys_env_set_status((envid_t)a1, (int)a2);
-		case SYS_env_set_pgfault_upcall:
-			// cprintf("syscall: sys_env_set_pgfault_upcall\n");
-			return sys_env_set_pgfault_upcall((envid_t)a1, (void *)a2);
-		case SYS_print_pgdir_va_info:
-			return sys_print_pgdir_va_info((pde_t *)a1, (void *)a2);
-		case SYS_ipc_try_send:
-			return sys_ipc_try_send((envid_t)a1, (uint32_t)a2, (void *)a3, (unsigned int) a4);
-		case SYS_ipc_recv:
-			return sys_ipc_recv((void *)a1);
-		case SYS_env_set_trapframe:
-			return sys_env_set_trapframe((envid_t)a1, (struct Trapframe *)a2);
-		default:
-			return -E_INVAL;
+// System calls that may be queued in a batch: those that always
+// return to their caller without blocking or switching environments.
+static const bool batchable[NSYSCALLS] = {
+	[SYS_cputs] =			true,
+	[SYS_getenvid] =		true,
+	[SYS_page_alloc] =		true,
+	[SYS_page_map] =		true,
+	[SYS_page_unmap] =		true,
+	[SYS_env_set_status] =		true,
+	[SYS_env_set_trapframe] =	true,
+	[SYS_env_set_pgfault_upcall] =	true,
+	[SYS_ipc_try_send] =		true,
+	[SYS_futex_wake] =		true,
+	[SYS_notify] =			true,
+	[SYS_page_map_range] =		true,
+	[SYS_page_unmap_range] =	true,
+	[SYS_page_protect_range] =	true,
+};
+
+// Run the system calls queued in the current environment's ring at
+// USYSRING, storing each one's result in its entry.  A call that may
+// not be batched gets -E_INVAL.
+// Returns the number of calls run, or < 0 on error.  Errors are:
+//	-E_FAULT if the ring is not mapped writable at USYSRING.
+//	-E_INVAL if more than SRING_SIZE calls are queued.
+static int
+sys_batch(void)
+{
+	struct SyscallRing *ring = (struct SyscallRing *) USYSRING;
+	struct SyscallEntry *se;
+	uint32_t tail;
+	int n;
+
+	if (user_mem_check(curenv, ring, PGSIZE, PTE_U | PTE_W) < 0)
+		return -E_FAULT;
+	if (ring->sr_head - ring->sr_tail > SRING_SIZE)
+		return -E_INVAL;
+
+	for (n = 0; (tail = ring->sr_tail) != ring->sr_head; n++) {
+		se = &ring->sr_ent[tail % SRING_SIZE];
+		if (se->se_num < NSYSCALLS && batchable[se->se_num])
+			se->se_result = syscalls[se->se_num](se->se_args[0],
+				se->se_args[1], se->se_args[2],
+				se->se_args[3], se->se_args[4]);
+		else
+			se->se_result = -E_INVAL;
+		ring->sr_tail = tail + 1;
+		// A call may have unmapped or write-protected the ring.
+		if (user_mem_check(curenv, ring, PGSIZE, PTE_U | PTE_W) < 0)
+			return n + 1;
 	}
-	return result;
+	return n;
 }
 
+// Dispatches to the correct kernel function, passing the arguments.
+int32_t
+syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5)
+{
+	if (syscallno >= NSYSCALLS || !syscalls[syscallno])
+		return -E_INVAL;
+	// A timeout set by sys_set_timeout applies to this call only.
+	if (syscallno != SYS_set_timeout) {
+		curenv->env_wait_timeout = curenv->env_next_timeout;
+		curenv->env_next_timeout = 0;
+	}
+	return syscalls[syscallno](a1, a2, a3, a4, a5);
+}
@@ -5,8 +5,12 @@
 #endif
 
 #include <inc/syscall.h>
+#include <inc/env.h>
 
 int32_t syscall(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5);
+void ipc_env_free(struct Env *e);
+void env_notify(struct Env *e, uint32_t bits);
+void env_wait_expired(struct Env *e);
 
 
 
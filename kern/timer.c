@@ -0,0 +1,98 @@
+// Kernel timers.
+//
+// Each environment has one timer, used to end a blocking wait.  Armed
+// timers hang off a hashed timer wheel: slot (expiry tick % WHEEL_SIZE)
+// holds every timer due at that tick or a multiple of WHEEL_SIZE ticks
+// later.  Arming and cancelling are O(1), and each timer interrupt only
+// looks at the slots for the ticks that have passed since the last one.
+// Ticks are derived from the TSC, not counted, so CPUs that take
+// timer interrupts at slightly different times agree on the time, and
+// ticks missed while interrupts were off are caught up.
+//
+// An environment blocked with its timer armed is not runnable, so it
+// costs the scheduler nothing until the timer fires.
+
+#include <inc/assert.h>
+
+#include <kern/env.h>
+#include <kern/kclock.h>
+#include <kern/syscall.h>
+#include <kern/timer.h>
+
+#define WHEEL_SIZE	256	// Slots; 2.56 seconds at 100 Hz
+
+// Longest timeout; anything longer might as well be forever.
+#define MAX_TIMEOUT	(1ULL << 62)
+
+static struct Env *wheel[WHEEL_SIZE];
+static uint64_t wheel_tick;	// Last tick whose timers have fired
+static int ntimers;		// Number of armed timers
+
+// Arm e's timer to fire 'nsec' nanoseconds from now, rounded up to the
+// next tick; a timeout of 0 fires at the next tick.  When it fires,
+// env_wait_expired(e) ends e's wait.  Replaces any timer already armed.
+void
+timer_arm(struct Env *e, uint64_t nsec)
+{
+	struct Env **slot;
+
+	timer_cancel(e);
+	nsec = MIN(nsec, MAX_TIMEOUT);
+	e->env_timer_expire = MAX((clock_nsec() + nsec + TICK_NSEC - 1) / TICK_NSEC,
+				  wheel_tick + 1);
+	slot = &wheel[e->env_timer_expire % WHEEL_SIZE];
+	e->env_timer_prev = NULL;
+	e->env_timer_next = *slot;
+	if (*slot)
+		(*slot)->env_timer_prev = e;
+	*slot = e;
+	e->env_timer_armed = true;
+	ntimers++;
+}
+
+// Disarm e's timer, if it is armed.
+void
+timer_cancel(struct Env *e)
+{
+	if (!e->env_timer_armed)
+		return;
+	if (e->env_timer_prev)
+		e->env_timer_prev->env_timer_next = e->env_timer_next;
+	else
+		wheel[e->env_timer_expire % WHEEL_SIZE] = e->env_timer_next;
+	if (e->env_timer_next)
+		e->env_timer_next->env_timer_prev = e->env_timer_prev;
+	e->env_timer_next = e->env_timer_prev = NULL;
+	e->env_timer_armed = false;
+	ntimers--;
+}
+
+// Fire every timer that has expired since the last call.
+// Called on every timer interrupt, with the kernel lock held.
+void
+timer_tick(void)
+{
+	uint64_t now = clock_nsec() / TICK_NSEC, t;
+	struct Env *e, *next;
+
+	if (now <= wheel_tick)
+		return;
+	// Visit each slot at most once, however many ticks were missed.
+	t = now - wheel_tick > WHEEL_SIZE ? now - WHEEL_SIZE : wheel_tick;
+	for (; t < now && ntimers > 0; t++)
+		for (e = wheel[(t + 1) % WHEEL_SIZE]; e; e = next) {
+			next = e->env_timer_next;
+			if (e->env_timer_expire <= now) {
+				timer_cancel(e);
+				env_wait_expired(e);
+			}
+		}
+	wheel_tick = now;
+}
+
+// Is any timer armed?
+bool
+timer_pending(void)
+{
+	return ntimers > 0;
+}
@@ -0,0 +1,21 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_TIMER_H
+#define JOS_KERN_TIMER_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/env.h>
+#include <inc/clock.h>
+
+// The LAPIC timer interrupts every CPU TIMER_HZ times a second.
+#define TIMER_HZ	100
+#define TICK_NSEC	(NSEC_PER_SEC / TIMER_HZ)
+
+void timer_arm(struct Env *e, uint64_t nsec);
+void timer_cancel(struct Env *e);
+void timer_tick(void);
+bool timer_pending(void);
+
+#endif	// !JOS_KERN_TIMER_H
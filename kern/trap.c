@@ -14,6 +14,7 @@
 #include <kern/picirq.h>
 #include <kern/cpu.h>
 #include <kern/spinlock.h>
+#include <kern/timer.h>
 
 static struct Taskstate ts;
 
@@ -150,15 +151,20 @@ trap_init_percpu(void)
 	// user space on that CPU.
 	//
 	// LAB 4: Your code here:
-	thiscpu->cpu_ts.ts_esp0 = (uint32_t)percpu_kstacks[cpunum()];
-	thiscpu->cpu_ts.ts_ss0 = GD_KD;
-	thiscpu->cpu_ts.ts_iomb = sizeof(struct Taskstate);
+	int id = thiscpu - cpus;
+	struct CpuInfo *cpu = thiscpu;
+	uintptr_t kstacktop = KSTACKTOP - id * (KSTKSIZE + KSTKGAP);
+	uint32_t edx;
+
+	cpu->cpu_ts.ts_esp0 = kstacktop;
+	cpu->cpu_ts.ts_ss0 = GD_KD;
+	cpu->cpu_ts.ts_iomb = sizeof(struct Taskstate);
 
 	
 	// set per cpu TSS descriptor and TSS
-	gdt[(GD_TSS0 >> 3) + cpunum()] = SEG16(STS_T32A, (uint32_t) (&(thiscpu->cpu_ts)),
+	gdt[(GD_TSS0 >> 3) + id] = SEG16(STS_T32A, (uint32_t) (&(cpu->cpu_ts)),
 					sizeof(struct Taskstate) - 1, 0);
-	gdt[(GD_TSS0 >> 3) + cpunum()].sd_s = 0;
+	gdt[(GD_TSS0 >> 3) + id].sd_s = 0;
 
 	// Setup a TSS so that we get the right stack
 	// when we trap to the kernel.
@@ -174,10 +180,20 @@ trap_init_percpu(void)
 	// Load the TSS selector (like other segment selectors, the
 	// bottom three bits are special; we leave them 0)
 	// 
-	ltr(GD_TSS0 + (cpunum()<<3));
+	ltr(GD_TSS0 + (id << 3));
 
 	// Load the IDT
 	lidt(&idt_pd);
+
+	// Set up the SYSENTER fast system call path, if this CPU has
+	// it.  SYSENTER loads %ss from the MSR's %cs + 8 and SYSEXIT
+	// %cs and %ss from + 16 and + 24, which the GDT layout matches.
+	cpuid(1, NULL, NULL, NULL, &edx);
+	if (edx & CPUID_FEAT_SEP) {
+		wrmsr(MSR_SYSENTER_CS, GD_KT);
+		wrmsr(MSR_SYSENTER_ESP, kstacktop);
+		wrmsr(MSR_SYSENTER_EIP, (uintptr_t) sysenter_handler);
+	}
 }
 
 void
@@ -258,9 +274,11 @@ trap_dispatch(struct Trapframe *tf)
 	} else if(tf->tf_trapno == (IRQ_OFFSET + IRQ_KBD) ){
 		lapic_eoi();
 		kbd_intr();
+		cons_wakeup();
 	} else if(tf->tf_trapno == (IRQ_OFFSET + IRQ_SERIAL) ){
 		lapic_eoi();
 		serial_intr();
+		cons_wakeup();
 	} else if (tf->tf_trapno == T_BRKPT){
 		monitor(tf);
 	} else if (tf->tf_trapno == T_SYSCALL){
@@ -270,14 +288,15 @@ trap_dispatch(struct Trapframe *tf)
 		uint32_t a3 = (uint32_t)tf->tf_regs.reg_ebx;
 		uint32_t a4 = (uint32_t)tf->tf_regs.reg_edi;
 		uint32_t a5 = (uint32_t)tf->tf_regs.reg_esi;
+		curenv->env_syscalls++;
 		int32_t result =  syscall(call_num, a1, a2, a3, a4, a5);
-		if (result != -E_INVAL){
-			tf->tf_regs.reg_eax = (uint32_t)result;
-		}
+		tf->tf_regs.reg_eax = (uint32_t)result;
 	} 
 	// click interrupt
 	else if(tf->tf_trapno == IRQ_OFFSET + IRQ_TIMER) {
 		lapic_eoi();
+		cons_wakeup();
+		timer_tick();
 		sched_yield();
 	} 
 	else {
@@ -328,7 +347,7 @@ trap(struct Trapframe *tf)
 		// Garbage collect if current enviroment is a zombie
 		if (curenv->env_status == ENV_DYING) {
 			env_free(curenv);
-			curenv = NULL;
+			percpu_write(cpu_env, NULL);
 			sched_yield();
 		}
 
@@ -356,6 +375,39 @@ trap(struct Trapframe *tf)
 		sched_yield();
 }
 
+// System calls made with SYSENTER come here from sysenter_handler in
+// trapentry.S, with a Trapframe built on the kernel stack.  This is
+// trap() cut down to what a system call needs: no trap_dispatch, and
+// back to user space with SYSEXIT rather than iret.
+void
+syscall_fast(struct Trapframe *tf)
+{
+	struct PushRegs *regs;
+
+	asm volatile("cld" ::: "cc");
+	assert(curenv);
+	lock_kernel();
+
+	// Garbage collect if current enviroment is a zombie
+	if (curenv->env_status == ENV_DYING) {
+		env_free(curenv);
+		percpu_write(cpu_env, NULL);
+		sched_yield();
+	}
+
+	// As in trap(): if we block, we resume from env_tf.
+	curenv->env_tf = *tf;
+	curenv->env_syscalls++;
+	regs = &curenv->env_tf.tf_regs;
+	regs->reg_eax = syscall(regs->reg_eax, regs->reg_edx, regs->reg_ecx,
+				regs->reg_ebx, regs->reg_edi, 0);
+
+	if (curenv->env_status != ENV_RUNNING)
+		sched_yield();
+	unlock_kernel();
+	sysexit_pop_tf(&curenv->env_tf);
+}
+
 int
 print_pgdir_va_info(pde_t *pgdir, void * va){
 
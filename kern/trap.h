@@ -84,6 +84,11 @@ extern void irq_15();
 
 extern void trap(struct Trapframe *);
 
+// SYSENTER fast system calls, in kern/trapentry.S and kern/trap.c
+extern void sysenter_handler(void);
+void sysexit_pop_tf(struct Trapframe *tf) __attribute__((noreturn));
+void syscall_fast(struct Trapframe *tf) __attribute__((noreturn));
+
 
 
 
@@ -0,0 +1,105 @@
+// Kernel wait queues.
+
+#include <inc/assert.h>
+
+#include <kern/env.h>
+#include <kern/sched.h>
+#include <kern/wait.h>
+#include <kern/timer.h>
+
+void
+wq_init(struct WaitQueue *wq)
+{
+	wq->wq_head = wq->wq_tail = NULL;
+}
+
+// Append e to the tail of wq and mark it not runnable.
+// The caller must not let e run again until it is woken.
+// If e is the current environment and its system call has a timeout,
+// arm e's timer, so the wait ends when it fires if not before.
+void
+wq_enqueue(struct WaitQueue *wq, struct Env *e)
+{
+	assert(e->env_waitq == NULL);
+
+	if (e == curenv && e->env_wait_timeout) {
+		timer_arm(e, e->env_wait_timeout);
+		e->env_wait_timeout = 0;
+	}
+
+	e->env_waitq = wq;
+	e->env_wait_next = NULL;
+	e->env_wait_prev = wq->wq_tail;
+	if (wq->wq_tail)
+		wq->wq_tail->env_wait_next = e;
+	else
+		wq->wq_head = e;
+	wq->wq_tail = e;
+	e->env_status = ENV_NOT_RUNNABLE;
+}
+
+// Block the current environment on wq and run something else.
+// The environment's saved registers must already be in curenv->env_tf
+// (true for any system call), since that is where it resumes.
+void
+wq_sleep(struct WaitQueue *wq)
+{
+	wq_enqueue(wq, curenv);
+	sched_yield();
+}
+
+// Remove e from whatever wait queue it is on, if any.
+// Does not change its status.
+void
+wq_remove(struct Env *e)
+{
+	struct WaitQueue *wq = e->env_waitq;
+
+	if (!wq)
+		return;
+	if (e->env_wait_prev)
+		e->env_wait_prev->env_wait_next = e->env_wait_next;
+	else
+		wq->wq_head = e->env_wait_next;
+	if (e->env_wait_next)
+		e->env_wait_next->env_wait_prev = e->env_wait_prev;
+	else
+		wq->wq_tail = e->env_wait_prev;
+	e->env_waitq = NULL;
+	e->env_wait_next = e->env_wait_prev = NULL;
+}
+
+// Wake up e, which must be blocked, making 'ret' the return value of
+// the system call it blocked in.  Cancels its timeout, if any.
+void
+wq_wakeup_env(struct Env *e, int32_t ret)
+{
+	timer_cancel(e);
+	wq_remove(e);
+	e->env_tf.tf_regs.reg_eax = ret;
+	e->env_status = ENV_RUNNABLE;
+}
+
+// Wake up the environment that has waited longest on wq.
+// Returns it, or NULL if nobody was waiting.
+struct Env *
+wq_wakeup_one(struct WaitQueue *wq, int32_t ret)
+{
+	struct Env *e = wq->wq_head;
+
+	if (e)
+		wq_wakeup_env(e, ret);
+	return e;
+}
+
+// Wake up every environment waiting on wq.
+// Returns how many were woken.
+int
+wq_wakeup_all(struct WaitQueue *wq, int32_t ret)
+{
+	int n = 0;
+
+	while (wq_wakeup_one(wq, ret))
+		n++;
+	return n;
+}
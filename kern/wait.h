@@ -0,0 +1,31 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_WAIT_H
+#define JOS_KERN_WAIT_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/env.h>
+
+// Wait queues let an environment block in the kernel until some event
+// occurs, without consuming any CPU time.  The kernel has no per-env
+// kernel stacks, so a sleeping environment does not resume inside the
+// kernel: it resumes in user space at the instruction after its system
+// call, with %eax set to the value passed by whoever woke it up.
+
+void wq_init(struct WaitQueue *wq);
+void wq_sleep(struct WaitQueue *wq) __attribute__((noreturn));
+void wq_enqueue(struct WaitQueue *wq, struct Env *e);
+void wq_wakeup_env(struct Env *e, int32_t ret);
+struct Env *wq_wakeup_one(struct WaitQueue *wq, int32_t ret);
+int wq_wakeup_all(struct WaitQueue *wq, int32_t ret);
+void wq_remove(struct Env *e);
+
+static inline bool
+wq_empty(struct WaitQueue *wq)
+{
+	return wq->wq_head == NULL;
+}
+
+#endif	// !JOS_KERN_WAIT_H
@@ -0,0 +1,109 @@
+// Batched system calls.
+//
+// sysbatch() queues a system call in this environment's ring at
+// USYSRING instead of trapping into the kernel; sysbatch_flush() runs
+// everything queued with a single SYS_batch trap.  Queued calls run in
+// order, and only when the batch is flushed, so callers must not
+// depend on their effects (or their results) until then.
+// sysbatch_discard() drops the queued calls without running them.
+
+#include <inc/lib.h>
+
+#define ring	((struct SyscallRing *) USYSRING)
+
+// Largest number of calls to queue before flushing.  Setting it to 1
+// runs every call as soon as it is queued, like an ordinary system call.
+int sysbatch_max = SRING_SIZE;
+
+// First error returned by a call flushed since the last sysbatch_flush.
+static int batch_error;
+
+// Map the ring if it is not there yet: it is not copied by fork, so a
+// new child has none.
+static int
+sysbatch_map(void)
+{
+	int r;
+
+	if ((uvpd[PDX(USYSRING)] & PTE_P) && (uvpt[PGNUM(USYSRING)] & PTE_P))
+		return 0;
+	if ((r = sys_page_alloc(0, USYSRING, PTE_P|PTE_U|PTE_W)) < 0)
+		return r;
+	ring->sr_head = ring->sr_tail = 0;
+	return 0;
+}
+
+// Run the queued calls, keeping the first error any of them returns.
+static int
+sysbatch_run(void)
+{
+	uint32_t i, head = ring->sr_head;
+	int r;
+
+	if (head == ring->sr_tail)
+		return 0;
+	i = ring->sr_tail;
+	if ((r = sys_batch()) < 0)
+		return r;
+	for (; i != head; i++)
+		if (ring->sr_ent[i % SRING_SIZE].se_result < 0 && !batch_error)
+			batch_error = ring->sr_ent[i % SRING_SIZE].se_result;
+	return 0;
+}
+
+// Queue system call 'num' with the given arguments, running the batch
+// first if it is full.  Returns 0, or < 0 if the ring could not be set
+// up or a full batch could not be run; errors from the calls
+// themselves are reported by sysbatch_flush.
+int
+sysbatch(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
+	 uint32_t a5)
+{
+	struct SyscallEntry *se;
+	int r;
+
+	if ((r = sysbatch_map()) < 0)
+		return r;
+	if (ring->sr_head - ring->sr_tail >= MAX(MIN(sysbatch_max, SRING_SIZE), 1)
+	    && (r = sysbatch_run()) < 0)
+		return r;
+
+	se = &ring->sr_ent[ring->sr_head % SRING_SIZE];
+	se->se_num = num;
+	se->se_args[0] = a1;
+	se->se_args[1] = a2;
+	se->se_args[2] = a3;
+	se->se_args[3] = a4;
+	se->se_args[4] = a5;
+	ring->sr_head++;
+
+	if (sysbatch_max <= 1)
+		return sysbatch_run();
+	return 0;
+}
+
+// Run all queued calls.  Returns 0 if every call flushed since the last
+// sysbatch_flush succeeded, else the first error.
+int
+sysbatch_flush(void)
+{
+	int r;
+
+	if ((uvpd[PDX(USYSRING)] & PTE_P) && (uvpt[PGNUM(USYSRING)] & PTE_P)
+	    && (r = sysbatch_run()) < 0)
+		return r;
+	r = batch_error;
+	batch_error = 0;
+	return r;
+}
+
+// Drop all queued calls without running them, and forget the errors of
+// any already run.  For error paths that are about to undo what the
+// batch was setting up.
+void
+sysbatch_discard(void)
+{
+	if ((uvpd[PDX(USYSRING)] & PTE_P) && (uvpt[PGNUM(USYSRING)] & PTE_P))
+		ring->sr_head = ring->sr_tail;
+	batch_error = 0;
+}
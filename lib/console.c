@@ -83,8 +83,8 @@ devcons_read(struct Fd *fd, void *vbuf, size_t n)
 	if (n == 0)
 		return 0;
 
-	while ((c = sys_cgetc()) == 0)
-		sys_yield();
+	// Sleeps in the kernel until a character arrives.
+	c = sys_cgetc_wait();
 	if (c < 0)
 		return c;
 	if (c == 0x04)	// ctl-d is eof
@@ -6,6 +6,15 @@
 
 union Fsipc fsipcbuf __attribute__((aligned(PGSIZE)));
 
+// Window for range requests, just below the file descriptor table:
+// a request page followed by FSREQ_MAXPAGES data pages.  Its pages are
+// allocated on first use; fork leaves them copy-on-write, so they are
+// replaced if they are no longer writable.
+#define FSRANGE		((union Fsipc *) (0xD0000000 - (FSREQ_MAXPAGES + 1) * PGSIZE))
+#define FSRANGE_DATA	((char *) FSRANGE + PGSIZE)
+
+static envid_t fsenv;
+
 // Send an inter-environment request to the file server, and wait for
 // a reply.  The request body should be in fsipcbuf, and parts of the
 // response may be written back to fsipcbuf.
@@ -15,7 +24,6 @@ union Fsipc fsipcbuf __attribute__((aligned(PGSIZE)));
 static int
 fsipc(unsigned type, void *dstva)
 {
-	static envid_t fsenv;
 	if (fsenv == 0)
 		fsenv = ipc_find_env(ENV_TYPE_FS);
 
@@ -24,8 +32,45 @@ fsipc(unsigned type, void *dstva)
 	if (debug)
 		cprintf("[%08x] fsipc %d %08x\n", thisenv->env_id, type, *(uint32_t *)&fsipcbuf);
 
-	ipc_send(fsenv, type, &fsipcbuf, PTE_P | PTE_W | PTE_U);
-	return ipc_recv(NULL, dstva, NULL);
+	return ipc_call(fsenv, type, &fsipcbuf, PTE_P | PTE_W | PTE_U,
+			dstva, NULL);
+}
+
+// Make sure the request page of FSRANGE and enough data pages for
+// 'n' bytes are mapped writable.  Returns the number of data pages.
+static int
+fsipc_prepare_range(size_t n)
+{
+	size_t i, npages = ROUNDUP(n, PGSIZE) / PGSIZE;
+	uintptr_t va;
+	int r;
+
+	for (i = 0; i <= npages; i++) {
+		va = (uintptr_t) FSRANGE + i * PGSIZE;
+		if ((uvpd[PDX(va)] & PTE_P) && (uvpt[PGNUM(va)] & PTE_W))
+			continue;
+		if ((r = sys_page_alloc(0, (void *) va, PTE_P | PTE_W | PTE_U)) < 0)
+			return r;
+	}
+	return npages;
+}
+
+// Like fsipc, but send the request in FSRANGE along with the first
+// 'npages' data pages after it (see fsipc_prepare_range).  The server
+// reads or writes the data pages directly, so the whole transfer takes
+// a single round trip.
+static int
+fsipc_range(unsigned type, size_t npages)
+{
+	if (fsenv == 0)
+		fsenv = ipc_find_env(ENV_TYPE_FS);
+
+	if (debug)
+		cprintf("[%08x] fsipc_range %d %d pages\n", thisenv->env_id, type, npages);
+
+	return ipc_call(fsenv, type, FSRANGE,
+			PTE_P | PTE_W | PTE_U | IPC_SENDPAGES(npages + 1),
+			NULL, NULL);
 }
 
 static int devfile_flush(struct Fd *fd);
@@ -115,7 +160,21 @@ devfile_read(struct Fd *fd, void *buf, size_t n)
 	// filling fsipcbuf.read with the request arguments.  The
 	// bytes read will be written back to fsipcbuf by the file
 	// system server.
-	int r;
+	int r, npages;
+
+	if (n > PGSIZE) {
+		// Too big for one page: read straight into range pages.
+		n = MIN(n, FSREQ_MAXPAGES * PGSIZE);
+		if ((npages = fsipc_prepare_range(n)) < 0)
+			return npages;
+		FSRANGE->range.req_fileid = fd->fd_file.id;
+		FSRANGE->range.req_n = n;
+		if ((r = fsipc_range(FSREQ_READ_RANGE, npages)) < 0)
+			return r;
+		assert(r <= n);
+		memmove(buf, FSRANGE_DATA, r);
+		return r;
+	}
 
 	fsipcbuf.read.req_fileid = fd->fd_file.id;
 	fsipcbuf.read.req_n = n;
@@ -142,9 +201,17 @@ devfile_write(struct Fd *fd, const void *buf, size_t n)
 	// remember that write is always allowed to write *fewer*
 	// bytes than requested.
 	// LAB 5: Your code here
-	int r;
-	if(n > sizeof(fsipcbuf.write.req_buf)){
-		n = sizeof(fsipcbuf.write.req_buf);
+	int r, npages;
+
+	if (n > sizeof(fsipcbuf.write.req_buf)) {
+		// Too big for one page: send the data in range pages.
+		n = MIN(n, FSREQ_MAXPAGES * PGSIZE);
+		if ((npages = fsipc_prepare_range(n)) < 0)
+			return npages;
+		FSRANGE->range.req_fileid = fd->fd_file.id;
+		FSRANGE->range.req_n = n;
+		memmove(FSRANGE_DATA, buf, n);
+		return fsipc_range(FSREQ_WRITE_RANGE, npages);
 	}
 
 	fsipcbuf.write.req_fileid = fd->fd_file.id;
@@ -178,6 +245,44 @@ devfile_trunc(struct Fd *fd, off_t newsize)
 }
 
 
+// Get the file server's block cache counters, first setting the cache
+// size to 'limit' blocks if that is nonzero and the largest read-ahead
+// window to 'ramax' blocks if that is not negative.
+int
+fs_bcstat(int limit, int ramax, struct BcStat *st)
+{
+	int r;
+
+	fsipcbuf.bcstat.req_limit = limit;
+	fsipcbuf.bcstat.req_ramax = ramax;
+	if ((r = fsipc(FSREQ_BCSTAT, NULL)) < 0)
+		return r;
+	*st = fsipcbuf.bcstatRet;
+	return 0;
+}
+
+// Get the file system's size and free space.
+int
+statfs(struct Statfs *st)
+{
+	int r;
+
+	if ((r = fsipc(FSREQ_STATFS, NULL)) < 0)
+		return r;
+	*st = fsipcbuf.statfsRet;
+	return 0;
+}
+
+// Delete a file
+int
+remove(const char *path)
+{
+	if (strlen(path) >= MAXPATHLEN)
+		return -E_BAD_PATH;
+	strcpy(fsipcbuf.remove.req_path, path);
+	return fsipc(FSREQ_REMOVE, NULL);
+}
+
 // Synchronize disk with buffer cache
 int
 sync(void)
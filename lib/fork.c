@@ -59,6 +59,8 @@ pgfault(struct UTrapframe *utf)
 // copy-on-write again if it was already copy-on-write at the beginning of
 // this function?)
 //
+// The mappings are queued with sysbatch; the caller must flush them.
+//
 // Returns: 0 on success, < 0 on error.
 // It is also OK to panic on error.
 //
@@ -66,25 +68,25 @@ static int
 duppage(envid_t envid, unsigned pn)
 {
 	int r;
+	uint32_t va = pn * PGSIZE;
 
 	// LAB 4: Your code here.
 	int perm = PTE_U | PTE_P;
 
 	if(uvpt[pn] & PTE_SHARE){
-		r = sys_page_map(thisenv->env_id, (void *)(pn * PGSIZE), envid, (void *)(pn * PGSIZE), uvpt[pn] & PTE_SYSCALL);
+		r = sysbatch(SYS_page_map, 0, va, envid, va, uvpt[pn] & PTE_SYSCALL);
 		if(r < 0) return r;
 	}else if(uvpt[pn] & (PTE_W | PTE_COW)){
 		int new_perm = perm | PTE_COW;
 		// remap chile
-
-		r = sys_page_map(0, (void *)(pn * PGSIZE), envid, (void *)(pn * PGSIZE), new_perm);
+		r = sysbatch(SYS_page_map, 0, va, envid, va, new_perm);
 		if (r < 0) panic("[duppage] failed to map parent(w|COW) -> child: %e\n", r);
 		// remap parent
-		r = sys_page_map(0, (void *)(pn * PGSIZE), 0, (void *)(pn * PGSIZE), new_perm);
+		r = sysbatch(SYS_page_map, 0, va, 0, va, new_perm);
 		if (r < 0) panic("[duppage] failed to map parent(w|COW) -> parent: %e\n", r);
 	}
 	else{
-		r = sys_page_map(0, (void *)(pn * PGSIZE), envid, (void*)(pn * PGSIZE), perm);
+		r = sysbatch(SYS_page_map, 0, va, envid, va, perm);
 		if (r < 0) panic("[duppage] failed to map parent(P|U) -> child: %e\n", r);
 	}
 	return 0;
@@ -130,27 +132,37 @@ fork(void)
 
 	uintptr_t vaddr;
 
+	// Queue all the mappings and the child's setup, then make them
+	// with as few traps as the batch size allows.
 	for(vaddr = 0; vaddr < USTACKTOP; vaddr += PGSIZE){
-		if (vaddr == (UXSTACKTOP - PGSIZE)){ 
+		if (vaddr == (UXSTACKTOP - PGSIZE) || vaddr == (uintptr_t) USYSRING){
 			continue;}
 		if((uvpd[PDX(vaddr)] & PTE_P) &&
 				(uvpt[PGNUM(vaddr)] & PTE_P)  &&
 				(uvpt[PGNUM(vaddr)] & PTE_U)){
-					duppage(cld_envid, vaddr / PGSIZE);
+					if ((err = duppage(cld_envid, vaddr / PGSIZE)) < 0)
+						goto error;
 				}
 	}
 
-	err = sys_page_alloc(cld_envid, (void*)(UXSTACKTOP - PGSIZE), PTE_P | PTE_W | PTE_U);
-
-	if (err < 0) return err;
-
 	extern void _pgfault_upcall();
-	err = sys_env_set_pgfault_upcall(cld_envid, _pgfault_upcall);
-	if (err < 0) return err;
-
-	err = sys_env_set_status(cld_envid, ENV_RUNNABLE);
-	if(err < 0) return err;
+	if ((err = sysbatch(SYS_page_alloc, cld_envid, UXSTACKTOP - PGSIZE,
+			    PTE_P | PTE_W | PTE_U, 0, 0)) < 0
+	    || (err = sysbatch(SYS_env_set_pgfault_upcall, cld_envid,
+			       (uint32_t) _pgfault_upcall, 0, 0, 0)) < 0
+	    || (err = sysbatch_flush()) < 0)
+		goto error;
+
+	// The batch goes on past a failed call, so start the child only
+	// once all of its setup is known to have succeeded.
+	if ((err = sys_env_set_status(cld_envid, ENV_RUNNABLE)) < 0)
+		goto error;
 	return cld_envid;
+
+error:
+	sysbatch_discard();	// drop anything still queued for the child
+	sys_env_destroy(cld_envid);
+	return err;
 }
 
 // Challenge!
@@ -35,27 +35,78 @@ ipc_recv(envid_t *from_env_store, void *pg, int *perm_store)
 	return thisenv->env_ipc_value;
 }
 
+// Like ipc_recv, but give up and return -E_TIMEOUT if no message
+// arrives within 'nsec' nanoseconds.
+int32_t
+ipc_recv_timeout(envid_t *from_env_store, void *pg, int *perm_store,
+		 uint64_t nsec)
+{
+	sys_set_timeout(nsec);
+	return ipc_recv(from_env_store, pg, perm_store);
+}
+
 // Send 'val' (and 'pg' with 'perm', if 'pg' is nonnull) to 'toenv'.
-// This function keeps trying until it succeeds.
-// It should panic() on any error other than -E_IPC_NOT_RECV.
+// This function sleeps in the kernel until 'toenv' receives the message.
+// It panics on any error.
 //
-// Hint:
-//   Use sys_yield() to be CPU-friendly.
-//   If 'pg' is null, pass sys_ipc_try_send a value that it will understand
-//   as meaning "no page".  (Zero is not the right value.)
+// If 'pg' is null, pass sys_ipc_send a value that it will understand
+// as meaning "no page".  (Zero is not the right value.)
 void
 ipc_send(envid_t to_env, uint32_t val, void *pg, int perm)
 {
 	// LAB 4: Your code here.
 	if(pg == NULL) pg = (void *)~0;
-	int r = sys_ipc_try_send(to_env, val, pg, perm);
-	while(r == -E_IPC_NOT_RECV){
-		sys_yield();
-		r = sys_ipc_try_send(to_env, val, pg, perm);
-	}
+	int r = sys_ipc_send(to_env, val, pg, perm);
 	if(r < 0) panic("[lib/ipc.c] ipc_send error: %e\n", r);
 }
 
+// Send 'val' (and 'pg' with 'perm', if 'pg' is nonnull) to 'to_env' and
+// wait for its reply, which must come from 'to_env'.  A page sent with the
+// reply is mapped at 'rcv_pg', if nonnull.  If 'perm_store' is nonnull,
+// store the reply's page permission there.
+// Returns the value of the reply.  Panics on any error.
+int32_t
+ipc_call(envid_t to_env, uint32_t val, void *pg, int perm, void *rcv_pg,
+	 int *perm_store)
+{
+	struct IpcMsg msg;
+	int r;
+
+	if (pg == NULL) pg = (void *)~0;
+	if (rcv_pg == NULL) rcv_pg = (void *)~0;
+	if ((r = sys_ipc_call(to_env, val, pg, perm, rcv_pg, &msg)) < 0)
+		panic("ipc_call to %08x: %e", to_env, r);
+	if (perm_store) *perm_store = msg.perm;
+	return msg.value;
+}
+
+// Reply to 'to_env' (if nonzero) with 'val' (and 'pg' with 'perm', if 'pg'
+// is nonnull), then wait for the next message as ipc_recv does.
+// A server loop calls this instead of ipc_send followed by ipc_recv.
+// If 'to_env' is not waiting for a reply from us (-E_IPC_NOT_RECV) or
+// has gone away (-E_BAD_ENV), returns that error without replying or
+// waiting: what to do with the reply is up to the server, which should
+// not block on the state of a client.
+int32_t
+ipc_reply_wait(envid_t to_env, uint32_t val, void *pg, int perm,
+	       void *rcv_pg, envid_t *from_env_store, int *perm_store)
+{
+	struct IpcMsg msg;
+	int r;
+
+	if (pg == NULL) pg = (void *)~0;
+	r = sys_ipc_reply_wait(to_env, val, pg, perm,
+			       rcv_pg ? rcv_pg : (void *)~0, &msg);
+	if (r < 0) {
+		if (from_env_store) *from_env_store = 0;
+		if (perm_store) *perm_store = 0;
+		return r;
+	}
+	if (from_env_store) *from_env_store = msg.from;
+	if (perm_store) *perm_store = msg.perm;
+	return msg.value;
+}
+
 // Find the first environment of the given type.  We'll use this to
 // find special environments.
 // Returns 0 if no such environment exists.
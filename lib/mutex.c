@@ -0,0 +1,112 @@
+// Mutexes and condition variables built on futexes.
+//
+// The fast paths never enter the kernel: an uncontended lock or unlock
+// is a single atomic instruction.  A waiter first spins for a while if
+// the holder is running on another CPU, since it will probably let go
+// soon, and only then sleeps in sys_futex_wait.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+// How many times to poll a held mutex before going to sleep.
+#define MUTEX_SPIN	100
+
+void
+mutex_init(struct mutex *m)
+{
+	m->m_state = 0;
+	m->m_owner = 0;
+}
+
+int
+mutex_trylock(struct mutex *m)
+{
+	if (cmpxchg(&m->m_state, 0, 1) != 0)
+		return -E_AGAIN;
+	m->m_owner = thisenv->env_id;
+	return 0;
+}
+
+// Is the holder of m running right now?
+static bool
+owner_running(struct mutex *m)
+{
+	envid_t owner = m->m_owner;
+
+	return owner && envs[ENVX(owner)].env_id == owner
+		&& envs[ENVX(owner)].env_status == ENV_RUNNING;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+	uint32_t c;
+	int i;
+
+	if ((c = cmpxchg(&m->m_state, 0, 1)) == 0)
+		goto out;
+
+	// Spin while the holder is making progress elsewhere.
+	for (i = 0; i < MUTEX_SPIN && owner_running(m); i++) {
+		asm volatile("pause");
+		if (m->m_state == 0 && (c = cmpxchg(&m->m_state, 0, 1)) == 0)
+			goto out;
+	}
+
+	// Mark the mutex contended and sleep until it is free.
+	if (c != 2)
+		c = xchg(&m->m_state, 2);
+	while (c != 0) {
+		sys_futex_wait(&m->m_state, 2);
+		c = xchg(&m->m_state, 2);
+	}
+out:
+	m->m_owner = thisenv->env_id;
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+	m->m_owner = 0;
+	// 1 -> 0 means nobody was waiting.
+	if (xadd(&m->m_state, -1) != 1) {
+		m->m_state = 0;
+		sys_futex_wake(&m->m_state, 1);
+	}
+}
+
+void
+cond_init(struct cond *c)
+{
+	c->c_seq = 0;
+}
+
+// Atomically release m and wait for c to be signaled, then reacquire m.
+// As usual, callers must recheck their condition after waking.
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+	uint32_t seq = c->c_seq;
+
+	mutex_unlock(m);
+	sys_futex_wait(&c->c_seq, seq);
+	// Others may have been woken with us; take the lock as contended
+	// so that our eventual unlock wakes them.
+	while (xchg(&m->m_state, 2) != 0)
+		sys_futex_wait(&m->m_state, 2);
+	m->m_owner = thisenv->env_id;
+}
+
+void
+cond_signal(struct cond *c)
+{
+	xadd(&c->c_seq, 1);
+	sys_futex_wake(&c->c_seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+	xadd(&c->c_seq, 1);
+	sys_futex_wake(&c->c_seq, FUTEX_WAKE_ALL);
+}
@@ -1,4 +1,5 @@
 #include <inc/lib.h>
+#include <inc/x86.h>
 
 #define debug 0
 
@@ -22,6 +23,8 @@ struct Dev devpipe =
 struct Pipe {
 	off_t p_rpos;		// read position
 	off_t p_wpos;		// write position
+	uint32_t p_rwaiting;	// a reader may be asleep on p_wpos
+	uint32_t p_wwaiting;	// a writer may be asleep on p_rpos
 	uint8_t p_buf[PIPEBUFSIZ];	// data buffer
 };
 
@@ -101,6 +104,38 @@ pipeisclosed(int fdnum)
 	return _pipeisclosed(fd, p);
 }
 
+// Sleep until *pos moves away from 'seen' or the other end of the pipe
+// is closed.  '*waiting' tells the other side to wake us.
+// Returns 1 if the pipe is closed, 0 otherwise.
+static int
+pipe_sleep(struct Fd *fd, struct Pipe *p, volatile off_t *pos, off_t seen,
+	   uint32_t *waiting)
+{
+	int refs;
+
+	// xchg is a full barrier, so either the other side sees our flag
+	// or we see its update to *pos.
+	xchg(waiting, 1);
+	if (*pos != seen)
+		return 0;
+	refs = pageref(p);
+	if (_pipeisclosed(fd, p))
+		return 1;
+	// Sleeps only if neither *pos nor the set of mappings of the pipe
+	// changed; unmapping a shared page wakes us, so a close cannot be
+	// missed.
+	sys_futex_wait_pageref((volatile uint32_t *) pos, seen, refs);
+	return 0;
+}
+
+// Wake anyone sleeping in pipe_sleep on *pos.
+static void
+pipe_wakeup(volatile off_t *pos, uint32_t *waiting)
+{
+	if (xchg(waiting, 0))
+		sys_futex_wake((volatile uint32_t *) pos, FUTEX_WAKE_ALL);
+}
+
 static ssize_t
 devpipe_read(struct Fd *fd, void *vbuf, size_t n)
 {
@@ -119,20 +154,23 @@ devpipe_read(struct Fd *fd, void *vbuf, size_t n)
 			// pipe is empty
 			// if we got any data, return it
 			if (i > 0)
-				return i;
+				goto out;
+			// sleep until a writer shows up;
 			// if all the writers are gone, note eof
-			if (_pipeisclosed(fd, p))
-				return 0;
-			// yield and see what happens
 			if (debug)
-				cprintf("devpipe_read yield\n");
-			sys_yield();
+				cprintf("devpipe_read sleep\n");
+			if (pipe_sleep(fd, p, &p->p_wpos, p->p_rpos,
+				       &p->p_rwaiting))
+				return 0;
 		}
 		// there's a byte.  take it.
 		// wait to increment rpos until the byte is taken!
 		buf[i] = p->p_buf[p->p_rpos % PIPEBUFSIZ];
 		p->p_rpos++;
 	}
+out:
+	// there is room now; let blocked writers at it
+	pipe_wakeup(&p->p_rpos, &p->p_wwaiting);
 	return i;
 }
 
@@ -155,12 +193,15 @@ devpipe_write(struct Fd *fd, const void *vbuf, size_t n)
 			// if all the readers are gone
 			// (it's only writers like us now),
 			// note eof
-			if (_pipeisclosed(fd, p))
-				return 0;
-			// yield and see what happens
+			// let readers drain what we wrote, then sleep
+			// until they make room
+			pipe_wakeup(&p->p_wpos, &p->p_rwaiting);
 			if (debug)
-				cprintf("devpipe_write yield\n");
-			sys_yield();
+				cprintf("devpipe_write sleep\n");
+			if (pipe_sleep(fd, p, &p->p_rpos,
+				       p->p_wpos - sizeof(p->p_buf),
+				       &p->p_wwaiting))
+				return 0;
 		}
 		// there's room for a byte.  store it.
 		// wait to increment wpos until the byte is stored!
@@ -168,6 +209,7 @@ devpipe_write(struct Fd *fd, const void *vbuf, size_t n)
 		p->p_wpos++;
 	}
 
+	pipe_wakeup(&p->p_wpos, &p->p_rwaiting);
 	return i;
 }
 
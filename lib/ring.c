@@ -0,0 +1,186 @@
+// Lock-free single-producer, single-consumer ring channels.
+//
+// A ring lives in pages shared (PTE_SHARE) between two environments:
+// a header page followed by a power-of-two number of data pages.
+// The producer only writes r_head and the consumer only writes r_tail,
+// and the two indexes sit on separate cache lines, so neither side
+// takes a lock and the lines do not bounce on every access.  Both
+// indexes count bytes since the ring was created; the difference is
+// the number of bytes in the buffer.
+//
+// A side goes to the kernel only when it has to block (ring empty or
+// full) or when it has to wake a peer that announced it is asleep.
+// Whole batches are copied before an index is published, so a large
+// transfer costs one index update and at most one wakeup.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define debug 0
+
+// Keep the compiler from moving memory accesses across this point.
+// x86 does not reorder stores with stores or loads with loads, so this
+// is all the ordering the data copies and index updates need.
+#define compiler_barrier()	asm volatile("" : : : "memory")
+
+static inline uint8_t *
+ring_buf(struct Ring *r)
+{
+	return (uint8_t *) r + PGSIZE;
+}
+
+// Create a ring at page-aligned address 'r' with 'npages' data pages,
+// which must be a power of two.  The pages are shared, so a child
+// created by fork or spawn sees the same ring at the same address.
+// Returns 0 on success, < 0 on error.
+int
+ring_create(struct Ring *r, size_t npages)
+{
+	size_t i;
+	int err;
+
+	if (PGOFF(r) || npages == 0 || (npages & (npages - 1)))
+		return -E_INVAL;
+	for (i = 0; i <= npages; i++)
+		if ((err = sys_page_alloc(0, (uint8_t *) r + i * PGSIZE,
+					  PTE_P|PTE_W|PTE_U|PTE_SHARE)) < 0)
+			goto fail;
+	r->r_size = npages * PGSIZE;
+	if (debug)
+		cprintf("[%08x] ring_create %08x size %d\n",
+			thisenv->env_id, r, r->r_size);
+	return 0;
+
+    fail:
+	while (i-- > 0)
+		sys_page_unmap(0, (uint8_t *) r + i * PGSIZE);
+	return err;
+}
+
+// Is the peer gone, either by closing its end or by unmapping the ring?
+static int
+ring_peer_closed(struct Ring *r, volatile uint32_t *closed)
+{
+	return *closed || pageref(r) < 2;
+}
+
+// Sleep until *pos moves away from 'seen' or the peer closes its end.
+// '*waiting' tells the peer to wake us.  This is the same protocol as
+// pipe_sleep in pipe.c.  Returns 1 if the peer is gone, 0 otherwise.
+static int
+ring_sleep(struct Ring *r, volatile uint32_t *pos, uint32_t seen,
+	   volatile uint32_t *waiting, volatile uint32_t *closed)
+{
+	int refs;
+
+	// xchg is a full barrier, so either the peer sees our flag or
+	// we see its update to *pos.
+	xchg(waiting, 1);
+	if (*pos != seen)
+		return 0;
+	refs = pageref(r);
+	if (ring_peer_closed(r, closed))
+		return 1;
+	sys_futex_wait_pageref(pos, seen, refs);
+	return 0;
+}
+
+// Wake the peer if it is asleep in ring_sleep on *pos.
+static void
+ring_wakeup(volatile uint32_t *pos, volatile uint32_t *waiting)
+{
+	// xchg is a full barrier: our index update is visible before
+	// we look at the flag, pairing with the xchg in ring_sleep.
+	if (xchg(waiting, 0))
+		sys_futex_wake(pos, FUTEX_WAKE_ALL);
+}
+
+// Copy all 'n' bytes of 'buf' into the ring, sleeping while it is full.
+// Returns n, or the number of bytes written before the consumer went
+// away (0 if none).
+ssize_t
+ring_write(struct Ring *r, const void *buf, size_t n)
+{
+	const uint8_t *src = buf;
+	uint32_t head, space, off, chunk;
+	size_t done = 0;
+
+	head = r->r_head;
+	while (done < n) {
+		while ((space = r->r_size - (head - r->r_tail)) == 0) {
+			if (ring_sleep(r, &r->r_tail, head - r->r_size,
+				       &r->r_pwait, &r->r_rclosed))
+				return done;
+		}
+		if (r->r_rclosed)
+			return done;
+		space = MIN(space, n - done);
+
+		// Copy the batch, wrapping at most once, then publish it.
+		off = head & (r->r_size - 1);
+		chunk = MIN(space, r->r_size - off);
+		memmove(ring_buf(r) + off, src + done, chunk);
+		memmove(ring_buf(r), src + done + chunk, space - chunk);
+		compiler_barrier();
+		head += space;
+		r->r_head = head;
+		done += space;
+
+		ring_wakeup(&r->r_head, &r->r_cwait);
+	}
+	return done;
+}
+
+// Read up to 'n' bytes from the ring into 'buf', taking everything
+// available in one batch.  Sleeps until at least one byte is there.
+// Returns the number of bytes read, or 0 at end of stream.
+ssize_t
+ring_read(struct Ring *r, void *buf, size_t n)
+{
+	uint8_t *dst = buf;
+	uint32_t tail, avail, off, chunk;
+
+	tail = r->r_tail;
+	while ((avail = r->r_head - tail) == 0) {
+		if (r->r_wclosed)
+			return 0;
+		if (ring_sleep(r, &r->r_head, tail, &r->r_cwait,
+			       &r->r_wclosed)) {
+			// Take whatever was written before the close.
+			if ((avail = r->r_head - tail) == 0)
+				return 0;
+			break;
+		}
+	}
+	compiler_barrier();
+	avail = MIN(avail, n);
+
+	off = tail & (r->r_size - 1);
+	chunk = MIN(avail, r->r_size - off);
+	memmove(dst, ring_buf(r) + off, chunk);
+	memmove(dst + chunk, ring_buf(r), avail - chunk);
+	compiler_barrier();
+	r->r_tail = tail + avail;
+
+	ring_wakeup(&r->r_tail, &r->r_pwait);
+	return avail;
+}
+
+// Close the producer's end: the consumer reads what is left, then
+// sees end of stream.
+void
+ring_close_write(struct Ring *r)
+{
+	r->r_wclosed = 1;
+	if (xchg(&r->r_cwait, 0))
+		sys_futex_wake(&r->r_head, FUTEX_WAKE_ALL);
+}
+
+// Close the consumer's end: further writes return short.
+void
+ring_close_read(struct Ring *r)
+{
+	r->r_rclosed = 1;
+	if (xchg(&r->r_pwait, 0))
+		sys_futex_wake(&r->r_tail, FUTEX_WAKE_ALL);
+}
@@ -5,6 +5,9 @@
 #define UTEMP2			(UTEMP + PGSIZE)
 #define UTEMP3			(UTEMP2 + PGSIZE)
 
+// Pages of a segment loaded per batch of system calls in map_segment
+#define SPAWN_BATCH		32
+
 // Helper functions for spawn.
 static int init_stack(envid_t child, const char **argv, uintptr_t *init_esp);
 static int map_segment(envid_t child, uintptr_t va, size_t memsz,
@@ -126,19 +129,23 @@ spawn(const char *prog, const char **argv)
 	fd = -1;
 
 	// Copy shared library state.
-	if ((r = copy_shared_pages(child)) < 0)
-		panic("copy_shared_pages: %e", r);
-
+	// (The mappings and the trap frame go in one batch.)
 	child_tf.tf_eflags |= FL_IOPL_3;   // devious: see user/faultio.c
-	if ((r = sys_env_set_trapframe(child, &child_tf)) < 0)
-		panic("sys_env_set_trapframe: %e", r);
+	if ((r = copy_shared_pages(child)) < 0
+	    || (r = sysbatch(SYS_env_set_trapframe, child,
+			     (uint32_t) &child_tf, 0, 0, 0)) < 0
+	    || (r = sysbatch_flush()) < 0)
+		goto error;
 
+	// The batch goes on past a failed call, so start the child only
+	// once all of its setup is known to have succeeded.
 	if ((r = sys_env_set_status(child, ENV_RUNNABLE)) < 0)
-		panic("sys_env_set_status: %e", r);
+		goto error;
 
 	return child;
 
 error:
+	sysbatch_discard();	// drop anything still queued for the child
 	sys_env_destroy(child);
 	close(fd);
 	return r;
@@ -264,7 +271,7 @@ static int
 map_segment(envid_t child, uintptr_t va, size_t memsz,
 	int fd, size_t filesz, off_t fileoffset, int perm)
 {
-	int i, r;
+	int i, j, n, r;
 	void *blk;
 
 	//cprintf("map_segment %x+%x\n", va, memsz);
@@ -276,28 +283,42 @@ map_segment(envid_t child, uintptr_t va, size_t memsz,
 		fileoffset -= i;
 	}
 
-	for (i = 0; i < memsz; i += PGSIZE) {
-		if (i >= filesz) {
-			// allocate a blank page
-			if ((r = sys_page_alloc(child, (void*) (va + i), perm)) < 0)
+	// Pages from the file are loaded SPAWN_BATCH at a time: allocate
+	// them at UTEMP in one batch, read the data, then move them all
+	// to the child in another.
+	for (i = 0; i < filesz; i += n * PGSIZE) {
+		n = MIN(ROUNDUP(filesz - i, PGSIZE) / PGSIZE, SPAWN_BATCH);
+		for (j = 0; j < n; j++)
+			if ((r = sysbatch(SYS_page_alloc, 0,
+					  (uint32_t) UTEMP + j * PGSIZE,
+					  PTE_P|PTE_U|PTE_W, 0, 0)) < 0)
 				return r;
-		} else {
-			// from file
-			if ((r = sys_page_alloc(0, UTEMP, PTE_P|PTE_U|PTE_W)) < 0)
+		if ((r = sysbatch_flush()) < 0)
+			return r;
+		if ((r = seek(fd, fileoffset + i)) < 0)
+			return r;
+		if ((r = readn(fd, UTEMP, MIN(n * PGSIZE, filesz - i))) < 0)
+			return r;
+		for (j = 0; j < n; j++) {
+			blk = UTEMP + j * PGSIZE;
+			if ((r = sysbatch(SYS_page_map, 0, (uint32_t) blk, child,
+					  va + i + j * PGSIZE, perm)) < 0
+			    || (r = sysbatch(SYS_page_unmap, 0, (uint32_t) blk,
+					     0, 0, 0)) < 0)
 				return r;
-			if ((r = seek(fd, fileoffset + i)) < 0)
-				return r;
-			if ((r = readn(fd, UTEMP, MIN(PGSIZE, filesz-i))) < 0)
-				return r;
-			if ((r = sys_page_map(0, UTEMP, child, (void*) (va + i), perm)) < 0)
-				panic("spawn: sys_page_map data: %e", r);
-			sys_page_unmap(0, UTEMP);
 		}
+		if ((r = sysbatch_flush()) < 0)
+			panic("spawn: sys_page_map data: %e", r);
 	}
-	return 0;
+	// allocate blank pages
+	for (i = ROUNDUP(filesz, PGSIZE); i < memsz; i += PGSIZE)
+		if ((r = sysbatch(SYS_page_alloc, child, va + i, perm, 0, 0)) < 0)
+			return r;
+	return sysbatch_flush();
 }
 
 // Copy the mappings for shared pages into the child address space.
+// The mappings are queued with sysbatch; the caller must flush them.
 static int
 copy_shared_pages(envid_t child)
 {
@@ -308,7 +329,7 @@ copy_shared_pages(envid_t child)
 	for(pn = PGNUM(UTEXT); pn < PGNUM(USTACKTOP); pn++){
 		if((uvpd[pn >> 10] & PTE_P) && (uvpt[pn] & PTE_P)){
 			if(uvpt[pn] & PTE_SHARE){
-				r = sys_page_map(thisenv->env_id, (void*)(pn*PGSIZE), child, (void*)(pn*PGSIZE), uvpt[pn]&PTE_SYSCALL);
+				r = sysbatch(SYS_page_map, 0, pn*PGSIZE, child, pn*PGSIZE, uvpt[pn]&PTE_SYSCALL);
 				if(r<0) return r;
 			}
 		}
@@ -2,11 +2,47 @@
 
 #include <inc/syscall.h>
 #include <inc/lib.h>
+#include <inc/x86.h>
+
+// Whether to enter the kernel with SYSENTER: -1 until syscall() has
+// checked that the CPU supports it, 0 to always use int $T_SYSCALL.
+int sysenter_enabled = -1;
+
+// Fast system call with SYSENTER: number in AX, up to four parameters
+// in DX, CX, BX, DI.  The kernel returns with SYSEXIT to the address in
+// SI with the stack pointer in BP, clobbering DX and CX.
+static inline int32_t
+sysenter(int num, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4)
+{
+	int32_t ret;
+
+	asm volatile("pushl %%ebp\n\t"
+		     "movl %%esp, %%ebp\n\t"
+		     "leal 1f, %%esi\n\t"
+		     "sysenter\n"
+		     "1:\tpopl %%ebp"
+		     : "=a" (ret), "+d" (a1), "+c" (a2)
+		     : "a" (num),
+		       "b" (a3),
+		       "D" (a4)
+		     : "esi", "cc", "memory");
+	return ret;
+}
 
 static inline int32_t
 syscall(int num, int check, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5)
 {
 	int32_t ret;
+	uint32_t edx;
+
+	if (sysenter_enabled < 0) {
+		cpuid(1, NULL, NULL, NULL, &edx);
+		sysenter_enabled = (edx & CPUID_FEAT_SEP) != 0;
+	}
+	if (sysenter_enabled && a5 == 0) {
+		ret = sysenter(num, a1, a2, a3, a4);
+		goto out;
+	}
 
 	// Generic system call: pass system call number in AX,
 	// up to five parameters in DX, CX, BX, DI, SI.
@@ -31,6 +67,7 @@ syscall(int num, int check, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
 		       "S" (a5)
 		     : "cc", "memory");
 
+out:
 	if(check && ret > 0)
 		panic("syscall %d returned %d (> 0)", num, ret);
 
@@ -111,14 +148,147 @@ sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, int perm)
 	return syscall(SYS_ipc_try_send, 0, envid, value, (uint32_t) srcva, perm, 0);
 }
 
+int
+sys_ipc_send(envid_t envid, uint32_t value, void *srcva, int perm)
+{
+	return syscall(SYS_ipc_send, 0, envid, value, (uint32_t) srcva, perm, 0);
+}
+
+// sys_ipc_call and sys_ipc_reply_wait return the received message in
+// DX, CX and BX, so they need their own stub.
+static int
+ipc_syscall_regs(int num, envid_t envid, uint32_t value, void *srcva,
+		 int perm, void *dstva, struct IpcMsg *msg)
+{
+	int32_t ret;
+	uint32_t val, from, rperm;
+
+	asm volatile("int %4\n"
+		     : "=a" (ret), "=d" (val), "=c" (from), "=b" (rperm)
+		     : "i" (T_SYSCALL),
+		       "a" (num),
+		       "1" (envid),
+		       "2" (value),
+		       "3" (srcva),
+		       "D" (perm),
+		       "S" (dstva)
+		     : "cc", "memory");
+
+	if (ret == 0 && msg) {
+		msg->value = val;
+		msg->from = from;
+		msg->perm = rperm;
+	}
+	return ret;
+}
+
+int
+sys_ipc_call(envid_t envid, uint32_t value, void *srcva, int perm,
+	     void *dstva, struct IpcMsg *msg)
+{
+	return ipc_syscall_regs(SYS_ipc_call, envid, value, srcva, perm,
+				dstva, msg);
+}
+
+int
+sys_ipc_reply_wait(envid_t envid, uint32_t value, void *srcva, int perm,
+		   void *dstva, struct IpcMsg *msg)
+{
+	return ipc_syscall_regs(SYS_ipc_reply_wait, envid, value, srcva, perm,
+				dstva, msg);
+}
+
 int
 sys_ipc_recv(void *dstva)
 {
 	return syscall(SYS_ipc_recv, 1, (uint32_t)dstva, 0, 0, 0, 0);
 }
 
+int
+sys_env_wait(envid_t envid)
+{
+	return syscall(SYS_env_wait, 0, envid, 0, 0, 0, 0);
+}
+
+int
+sys_cgetc_wait(void)
+{
+	return syscall(SYS_cgetc_wait, 0, 0, 0, 0, 0, 0);
+}
+
+int
+sys_futex_wait(volatile uint32_t *addr, uint32_t expected)
+{
+	return syscall(SYS_futex_wait, 0, (uint32_t) addr, expected, 0, 0, 0);
+}
+
+int
+sys_futex_wait_pageref(volatile uint32_t *addr, uint32_t expected, int refs)
+{
+	return syscall(SYS_futex_wait, 0, (uint32_t) addr, expected, refs, 0, 0);
+}
+
+int
+sys_futex_wake(volatile uint32_t *addr, uint32_t n)
+{
+	return syscall(SYS_futex_wake, 0, (uint32_t) addr, n, 0, 0, 0);
+}
+
+int
+sys_notify(envid_t envid, uint32_t bits)
+{
+	return syscall(SYS_notify, 0, envid, bits, 0, 0, 0);
+}
+
+int
+sys_wait_notify(uint32_t mask)
+{
+	return syscall(SYS_wait_notify, 0, mask, 0, 0, 0, 0);
+}
+
 int
 sys_print_pgdir_va_info(pde_t *pgdir, void * vaddr){
 	return syscall(SYS_print_pgdir_va_info, 0, (uint32_t)pgdir, (uint32_t)vaddr, 0, 0, 0);
 }
 
+int
+sys_batch(void)
+{
+	return syscall(SYS_batch, 0, 0, 0, 0, 0, 0);
+}
+
+int
+sys_page_map_range(envid_t srcenv, void *srcva, envid_t dstenv, void *dstva,
+		   size_t len, int perm)
+{
+	// len is page-aligned, so perm travels in its low bits.
+	if (PGOFF(len) || PGOFF(perm) != perm)
+		return -E_INVAL;
+	return syscall(SYS_page_map_range, 1, srcenv, (uint32_t) srcva, dstenv,
+		       (uint32_t) dstva, len | perm);
+}
+
+int
+sys_page_unmap_range(envid_t envid, void *va, size_t len)
+{
+	return syscall(SYS_page_unmap_range, 1, envid, (uint32_t) va, len, 0, 0);
+}
+
+int
+sys_page_protect_range(envid_t envid, void *va, size_t len, int perm)
+{
+	return syscall(SYS_page_protect_range, 1, envid, (uint32_t) va, len,
+		       perm, 0);
+}
+
+int
+sys_sleep(uint64_t nsec)
+{
+	return syscall(SYS_sleep, 0, (uint32_t) nsec, nsec >> 32, 0, 0, 0);
+}
+
+int
+sys_set_timeout(uint64_t nsec)
+{
+	return syscall(SYS_set_timeout, 0, (uint32_t) nsec, nsec >> 32, 0, 0, 0);
+}
@@ -0,0 +1,19 @@
+// Reading the time without entering the kernel.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+// Return the number of nanoseconds since boot, computed from the TSC
+// and the calibration in the read-only clock page.
+uint64_t
+time_nsec(void)
+{
+	return clock_tsc2nsec(&uclock, read_tsc());
+}
+
+// Return the current time in seconds since 1970-01-01 00:00 UTC.
+uint32_t
+time_epoch(void)
+{
+	return uclock.cp_boot_epoch + time_nsec() / NSEC_PER_SEC;
+}
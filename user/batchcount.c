@@ -0,0 +1,35 @@
+// Count the system call traps taken by fork and spawn, with and
+// without batching the page mapping calls.
+
+#include <inc/lib.h>
+
+static void
+measure(const char *what)
+{
+	uint32_t before;
+	envid_t child;
+
+	before = thisenv->env_syscalls;
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0)
+		exit();
+	cprintf("%s: fork took %d traps\n", what,
+		thisenv->env_syscalls - before);
+	wait(child);
+
+	before = thisenv->env_syscalls;
+	if ((child = spawnl("hello", "hello", 0)) < 0)
+		panic("spawn: %e", child);
+	cprintf("%s: spawn took %d traps\n", what,
+		thisenv->env_syscalls - before);
+	wait(child);
+}
+
+void
+umain(int argc, char **argv)
+{
+	measure("batched");
+	sysbatch_max = 1;
+	measure("unbatched");
+}
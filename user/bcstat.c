@@ -0,0 +1,28 @@
+// Print the file server's cache counters.
+// "bcstat N [R]" first sets the cache size to N blocks and the largest
+// read-ahead window to R blocks.
+
+#include <inc/lib.h>
+
+void
+umain(int argc, char **argv)
+{
+	struct BcStat st;
+	int r, limit = 0, ramax = -1;
+
+	if (argc > 3) {
+		cprintf("usage: bcstat [limit [readahead]]\n");
+		exit();
+	}
+	if (argc >= 2)
+		limit = strtol(argv[1], 0, 0);
+	if (argc == 3)
+		ramax = strtol(argv[2], 0, 0);
+	if ((r = fs_bcstat(limit, ramax, &st)) < 0)
+		panic("fs_bcstat: %e", r);
+	printf("limit %u cached %u dirty %u hits %u misses %u evictions %u "
+	       "readahead %u\n", st.bs_limit, st.bs_cached, st.bs_dirty,
+	       st.bs_hits, st.bs_misses, st.bs_evictions, st.bs_ramax);
+	printf("dcache hits %u negative %u misses %u\n",
+	       st.bs_dhits, st.bs_dneg_hits, st.bs_dmisses);
+}
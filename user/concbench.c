@@ -0,0 +1,127 @@
+// Measure how fast several clients read a file the block cache holds,
+// first on their own and then while another client reads a file that
+// misses the cache on every block.  The file server should keep
+// serving the cached reads while the other client waits for the disk.
+
+#include <inc/lib.h>
+
+#define HOT		"/conchot"
+#define COLD		"/conccold"
+#define HOTSIZE		(16 * 1024)	// Bytes in the cached file
+#define COLDSIZE	(1024 * 1024)	// Bytes in the uncached file
+#define NREADERS	3		// Readers of the cached file
+#define PASSES		64		// Times each one reads it
+#define CACHE		64		// Block cache size, in blocks
+
+char buf[8192];
+
+static void
+create(const char *path, int size)
+{
+	int fd, i, r;
+
+	if ((fd = open(path, O_RDWR|O_CREAT|O_TRUNC)) < 0)
+		panic("open %s: %e", path, fd);
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i;
+	for (i = 0; i < size / sizeof(buf); i++)
+		if ((r = write(fd, buf, sizeof(buf))) != sizeof(buf))
+			panic("write %s: %e", path, r);
+	close(fd);
+}
+
+static void
+readall(const char *path, int size)
+{
+	long n, total = 0;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		panic("open %s: %e", path, fd);
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		total += n;
+	if (n < 0)
+		panic("read %s: %e", path, n);
+	if (total != size)
+		panic("read %ld bytes of %s, want %d", total, path, size);
+	close(fd);
+}
+
+// Fork a reader of the cached file, which sends the parent the number
+// of microseconds its passes took.
+static envid_t
+hot_reader(envid_t parent)
+{
+	uint64_t start;
+	envid_t child;
+	int i;
+
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child)
+		return child;
+	start = time_nsec();
+	for (i = 0; i < PASSES; i++)
+		readall(HOT, HOTSIZE);
+	ipc_send(parent, (time_nsec() - start) / 1000, NULL, 0);
+	exit();
+	return 0;
+}
+
+static void
+run(const char *what, bool cold)
+{
+	envid_t parent = thisenv->env_id, hot[NREADERS], reader = 0;
+	uint64_t usec = 0;
+	int i;
+
+	if (cold) {
+		if ((reader = fork()) < 0)
+			panic("fork: %e", reader);
+		if (reader == 0)
+			while (1)
+				readall(COLD, COLDSIZE);
+	}
+	for (i = 0; i < NREADERS; i++)
+		hot[i] = hot_reader(parent);
+	for (i = 0; i < NREADERS; i++)
+		usec = MAX(usec, (uint32_t) ipc_recv(NULL, NULL, NULL));
+	for (i = 0; i < NREADERS; i++)
+		wait(hot[i]);
+	if (reader) {
+		sys_env_destroy(reader);
+		wait(reader);
+	}
+
+	cprintf("%s: %d readers, %llu us, %llu KB/s\n", what, NREADERS, usec,
+		(uint64_t) NREADERS * PASSES * HOTSIZE * 1000000 / 1024
+		/ MAX(usec, 1));
+}
+
+void
+umain(int argc, char **argv)
+{
+	struct BcStat old, st;
+	int r;
+
+	create(HOT, HOTSIZE);
+	create(COLD, COLDSIZE);
+
+	// A small cache and no read-ahead, so that the cold reader waits
+	// for the disk on every block.
+	if ((r = fs_bcstat(0, -1, &old)) < 0)
+		panic("fs_bcstat: %e", r);
+	if ((r = fs_bcstat(CACHE, 0, &st)) < 0)
+		panic("fs_bcstat: %e", r);
+	readall(HOT, HOTSIZE);
+
+	run("cached reads alone", false);
+	run("cached reads with a cold reader", true);
+
+	if ((r = fs_bcstat(old.bs_limit, old.bs_ramax, &st)) < 0)
+		panic("fs_bcstat: %e", r);
+	if ((r = remove(HOT)) < 0)
+		panic("remove %s: %e", HOT, r);
+	if ((r = remove(COLD)) < 0)
+		panic("remove %s: %e", COLD, r);
+}
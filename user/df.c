@@ -0,0 +1,16 @@
+// Print the size of the file system and how much of it is free.
+
+#include <inc/lib.h>
+
+void
+umain(int argc, char **argv)
+{
+	struct Statfs st;
+	int r;
+
+	if ((r = statfs(&st)) < 0)
+		panic("statfs: %e", r);
+	printf("%u blocks, %u used, %u free (%u KB free)\n",
+	       st.sf_nblocks, st.sf_nblocks - st.sf_nfree, st.sf_nfree,
+	       st.sf_nfree * (BLKSIZE / 1024));
+}
@@ -0,0 +1,47 @@
+// Time opening files in a large directory: create NFILES empty files
+// in the root directory, open each of them, then remove them.
+
+#include <inc/lib.h>
+
+#define NFILES		1000
+
+static void
+name(char *buf, int i)
+{
+	snprintf(buf, MAXNAMELEN, "/dirbench.%d", i);
+}
+
+void
+umain(int argc, char **argv)
+{
+	char path[MAXNAMELEN];
+	uint64_t start, nsec;
+	int i, fd;
+
+	for (i = 0; i < NFILES; i++) {
+		name(path, i);
+		if ((fd = open(path, O_RDWR|O_CREAT|O_EXCL)) < 0)
+			panic("create %s: %e", path, fd);
+		close(fd);
+	}
+
+	start = time_nsec();
+	for (i = 0; i < NFILES; i++) {
+		name(path, i);
+		if ((fd = open(path, O_RDONLY)) < 0)
+			panic("open %s: %e", path, fd);
+		close(fd);
+	}
+	nsec = time_nsec() - start;
+	cprintf("dirbench: %d opens in %llu us, %llu ns per open\n",
+		NFILES, nsec / 1000, nsec / NFILES);
+
+	for (i = 0; i < NFILES; i++) {
+		name(path, i);
+		if ((fd = remove(path)) < 0)
+			panic("remove %s: %e", path, fd);
+	}
+	if ((fd = open("/dirbench.0", O_RDONLY)) != -E_NOT_FOUND)
+		panic("open removed file: %e", fd);
+	cprintf("dirbench: ok\n");
+}
@@ -0,0 +1,31 @@
+// Measure null system call latency (sys_getenvid) through the
+// SYSENTER fast path and through int $T_SYSCALL.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define NITER	100000
+
+static uint64_t
+bench(void)
+{
+	uint64_t start;
+	int i;
+
+	start = read_tsc();
+	for (i = 0; i < NITER; i++)
+		sys_getenvid();
+	return (read_tsc() - start) / NITER;
+}
+
+void
+umain(int argc, char **argv)
+{
+	sys_getenvid();		// let syscall() probe for SYSENTER
+	if (sysenter_enabled)
+		cprintf("sysenter: %llu cycles per call\n", bench());
+	else
+		cprintf("sysenter: not supported\n");
+	sysenter_enabled = 0;
+	cprintf("int $T_SYSCALL: %llu cycles per call\n", bench());
+}
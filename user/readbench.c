@@ -0,0 +1,78 @@
+// Measure how fast a large file streams off the disk with the same
+// read loop as user/cat, with and without read-ahead in the file
+// server.  The block cache is emptied before each run.
+
+#include <inc/lib.h>
+
+#define FILE		"/readbench"
+#define SIZE		(1024 * 1024)	// Bytes in the test file
+
+char buf[8192];
+
+// Empty the block cache and set the read-ahead limit.
+static void
+reset_cache(int ramax)
+{
+	struct BcStat st;
+	int r;
+
+	if ((r = fs_bcstat(1, ramax, &st)) < 0)
+		panic("fs_bcstat: %e", r);
+	if ((r = fs_bcstat(st.bs_limit, -1, &st)) < 0)
+		panic("fs_bcstat: %e", r);
+}
+
+static void
+run(const char *what, int ramax)
+{
+	struct BcStat before, after;
+	uint64_t start, nsec;
+	long n, total = 0;
+	int fd, r;
+
+	reset_cache(ramax);
+	if ((r = fs_bcstat(0, -1, &before)) < 0)
+		panic("fs_bcstat: %e", r);
+	if ((fd = open(FILE, O_RDONLY)) < 0)
+		panic("open %s: %e", FILE, fd);
+	start = time_nsec();
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		total += n;
+	nsec = time_nsec() - start;
+	if (n < 0)
+		panic("read %s: %e", FILE, n);
+	if (total != SIZE)
+		panic("read %ld bytes, want %d", total, SIZE);
+	close(fd);
+	if ((r = fs_bcstat(0, -1, &after)) < 0)
+		panic("fs_bcstat: %e", r);
+
+	cprintf("%s: %d bytes in %llu us, %llu KB/s, %u misses\n",
+		what, SIZE, nsec / 1000,
+		(uint64_t) SIZE * NSEC_PER_SEC / 1024 / MAX(nsec, 1),
+		after.bs_misses - before.bs_misses);
+}
+
+void
+umain(int argc, char **argv)
+{
+	struct BcStat st;
+	int fd, i, r;
+
+	if ((fd = open(FILE, O_RDWR|O_CREAT|O_TRUNC)) < 0)
+		panic("open %s: %e", FILE, fd);
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i;
+	for (i = 0; i < SIZE / sizeof(buf); i++)
+		if ((r = write(fd, buf, sizeof(buf))) != sizeof(buf))
+			panic("write %s: %e", FILE, r);
+	close(fd);
+	if ((r = fs_bcstat(0, -1, &st)) < 0)
+		panic("fs_bcstat: %e", r);
+
+	run("no read-ahead", 0);
+	run("read-ahead", st.bs_ramax);
+
+	if ((r = remove(FILE)) < 0)
+		panic("remove %s: %e", FILE, r);
+}
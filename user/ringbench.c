@@ -0,0 +1,110 @@
+// Compare streaming throughput between two environments through a
+// shared-memory ring channel and through a pipe.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define TOTAL		(1024 * 1024)	// Bytes to move
+#define CHUNK		4096		// Bytes per read/write call
+#define RINGPAGES	16
+
+struct Ring *ring = (struct Ring *) 0xA0000000;
+uint8_t buf[CHUNK];
+
+// Fill buf with the i'th chunk of the stream; return its byte sum.
+static uint32_t
+fill(int i)
+{
+	uint32_t sum = 0;
+	int j;
+
+	for (j = 0; j < CHUNK; j++)
+		sum += (buf[j] = i * 7 + j);
+	return sum;
+}
+
+// Consume the stream with 'rd' and send the byte sum to the parent.
+static void
+consume(envid_t parent, ssize_t (*rd)(void *arg, void *buf, size_t n),
+	void *arg)
+{
+	uint32_t sum = 0;
+	ssize_t n, i;
+
+	while ((n = rd(arg, buf, sizeof(buf))) > 0)
+		for (i = 0; i < n; i++)
+			sum += buf[i];
+	ipc_send(parent, sum, NULL, 0);
+	exit();
+}
+
+static ssize_t
+ring_rd(void *arg, void *buf, size_t n)
+{
+	return ring_read(arg, buf, n);
+}
+
+static ssize_t
+pipe_rd(void *arg, void *buf, size_t n)
+{
+	return read(*(int *) arg, buf, n);
+}
+
+static void
+report(const char *what, uint64_t cycles, uint32_t sum, uint32_t want)
+{
+	if (sum != want)
+		panic("%s: checksum %08x, want %08x", what, sum, want);
+	cprintf("%s: %d bytes in %llu cycles, %llu bytes/kcycle\n",
+		what, TOTAL, cycles, (uint64_t) TOTAL * 1000 / cycles);
+}
+
+void
+umain(int argc, char **argv)
+{
+	envid_t parent = thisenv->env_id, child;
+	uint32_t want;
+	uint64_t start;
+	int i, r, p[2];
+
+	// Ring channel
+	if ((r = ring_create(ring, RINGPAGES)) < 0)
+		panic("ring_create: %e", r);
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0)
+		consume(parent, ring_rd, ring);
+	want = 0;
+	start = read_tsc();
+	for (i = 0; i < TOTAL / CHUNK; i++) {
+		want += fill(i);
+		if ((r = ring_write(ring, buf, CHUNK)) != CHUNK)
+			panic("ring_write: %d", r);
+	}
+	ring_close_write(ring);
+	r = ipc_recv(NULL, NULL, NULL);
+	report("ring", read_tsc() - start, r, want);
+	wait(child);
+
+	// Pipe
+	if ((r = pipe(p)) < 0)
+		panic("pipe: %e", r);
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		close(p[1]);
+		consume(parent, pipe_rd, &p[0]);
+	}
+	close(p[0]);
+	want = 0;
+	start = read_tsc();
+	for (i = 0; i < TOTAL / CHUNK; i++) {
+		want += fill(i);
+		if ((r = write(p[1], buf, CHUNK)) != CHUNK)
+			panic("write: %e", r);
+	}
+	close(p[1]);
+	r = ipc_recv(NULL, NULL, NULL);
+	report("pipe", read_tsc() - start, r, want);
+	wait(child);
+}
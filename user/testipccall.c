@@ -0,0 +1,47 @@
+// Test replying to a caller that is still queued to send its request:
+// the caller must get the reply, and a plain send it makes afterwards
+// must complete like any other send instead of waiting for a reply.
+
+#include <inc/lib.h>
+
+// Wait until env is blocked in the kernel.
+static void
+wait_blocked(envid_t env)
+{
+	while (envs[ENVX(env)].env_status != ENV_NOT_RUNNABLE)
+		sys_yield();
+}
+
+void
+umain(int argc, char **argv)
+{
+	envid_t parent = thisenv->env_id, child, from;
+	int32_t v;
+	int r;
+
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		// We are not received, so this queues on the parent.
+		if ((v = ipc_call(parent, 1, NULL, 0, NULL, NULL)) != 42)
+			panic("ipc_call got %d, want 42", v);
+		ipc_send(parent, 2, NULL, 0);
+		ipc_send(parent, 3, NULL, 0);
+		return;
+	}
+
+	// Answer the call without ever receiving its request.
+	while ((r = sys_ipc_try_send(child, 42, (void *) ~0, 0)) == -E_IPC_NOT_RECV)
+		sys_yield();
+	if (r < 0)
+		panic("sys_ipc_try_send: %e", r);
+
+	// Take the plain send only once it is queued on us.
+	wait_blocked(child);
+	if ((v = ipc_recv(&from, NULL, NULL)) != 2 || from != child)
+		panic("ipc_recv got %d from %08x, want 2 from %08x", v, from, child);
+	if ((v = ipc_recv(&from, NULL, NULL)) != 3 || from != child)
+		panic("ipc_recv got %d from %08x, want 3 from %08x", v, from, child);
+	wait(child);
+	cprintf("testipccall OK\n");
+}
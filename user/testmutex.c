@@ -0,0 +1,53 @@
+// Test futex-based mutexes and condition variables across environments
+// that share a page.
+
+#include <inc/lib.h>
+
+#define NCHILD	4
+#define NITER	1000
+
+struct shared {
+	struct mutex mu;
+	struct cond cv;
+	int counter;
+	int done;
+} *sh = (struct shared *) 0xA0000000;
+
+void
+umain(int argc, char **argv)
+{
+	int i, j, r;
+
+	if ((r = sys_page_alloc(0, sh, PTE_P|PTE_W|PTE_U|PTE_SHARE)) < 0)
+		panic("sys_page_alloc: %e", r);
+	mutex_init(&sh->mu);
+	cond_init(&sh->cv);
+
+	for (i = 0; i < NCHILD; i++) {
+		if ((r = fork()) < 0)
+			panic("fork: %e", r);
+		if (r == 0) {
+			for (j = 0; j < NITER; j++) {
+				mutex_lock(&sh->mu);
+				sh->counter++;
+				if (j % 100 == 0)
+					sys_yield();
+				mutex_unlock(&sh->mu);
+			}
+			mutex_lock(&sh->mu);
+			sh->done++;
+			cond_signal(&sh->cv);
+			mutex_unlock(&sh->mu);
+			exit();
+		}
+	}
+
+	mutex_lock(&sh->mu);
+	while (sh->done < NCHILD)
+		cond_wait(&sh->cv, &sh->mu);
+	mutex_unlock(&sh->mu);
+
+	if (sh->counter != NCHILD * NITER)
+		panic("counter is %d, expected %d", sh->counter, NCHILD * NITER);
+	cprintf("mutex test passed\n");
+}
@@ -0,0 +1,55 @@
+// Test asynchronous notification bits: bits posted before the wait
+// stay pending, a wait blocks until a masked bit arrives, bits outside
+// the mask are left alone, and a timed-out wait is told apart from
+// any bits it could return.
+
+#include <inc/lib.h>
+
+#define BIT_PING	0x1
+#define BIT_OTHER	0x2
+#define BIT_DONE	0x40000000
+
+void
+umain(int argc, char **argv)
+{
+	envid_t parent = thisenv->env_id, child;
+	uint32_t got;
+	int i, r;
+
+	// Bits posted to ourselves are pending until taken.
+	if ((r = sys_notify(0, BIT_OTHER)) < 0)
+		panic("sys_notify: %e", r);
+	if ((got = sys_wait_notify(BIT_OTHER | BIT_PING)) != BIT_OTHER)
+		panic("wait_notify got %08x, want %08x", got, BIT_OTHER);
+	if ((got = sys_wait_notify(0)) != 0)
+		panic("wait_notify(0) got %08x", got);
+	if ((r = sys_wait_notify(~NOTIFY_BITS)) != -E_INVAL)
+		panic("wait_notify(%08x) got %d, want -E_INVAL", ~NOTIFY_BITS, r);
+	sys_set_timeout(0);
+	if ((r = sys_wait_notify(NOTIFY_BITS)) != -E_TIMEOUT)
+		panic("timed-out wait_notify got %d, want -E_TIMEOUT", r);
+
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		for (i = 0; i < 10; i++) {
+			if ((got = sys_wait_notify(BIT_PING)) != BIT_PING)
+				panic("child got %08x", got);
+			sys_notify(parent, BIT_PING);
+		}
+		sys_notify(parent, BIT_OTHER | BIT_DONE);
+		return;
+	}
+
+	for (i = 0; i < 10; i++) {
+		sys_notify(child, BIT_PING);
+		if ((got = sys_wait_notify(BIT_PING)) != BIT_PING)
+			panic("parent got %08x", got);
+	}
+	// BIT_OTHER stays pending while we wait only for BIT_DONE.
+	if ((got = sys_wait_notify(BIT_DONE)) != BIT_DONE)
+		panic("parent got %08x, want %08x", got, BIT_DONE);
+	if ((got = sys_wait_notify(BIT_OTHER)) != BIT_OTHER)
+		panic("parent got %08x, want %08x", got, BIT_OTHER);
+	cprintf("testnotify OK\n");
+}
@@ -0,0 +1,93 @@
+// Test the range memory system calls: map, protect and unmap a span
+// with holes in it, spanning a page-table boundary.
+
+#include <inc/lib.h>
+
+#define NPAGES	8
+#define SRC	((uint8_t *) (0x10000000 - 4 * PGSIZE))	// crosses a PDE
+#define DST	((uint8_t *) 0x20000000)
+
+static bool
+is_hole(int i)
+{
+	return i == 2 || i == 5;
+}
+
+static pte_t
+pte(void *va)
+{
+	if (!(uvpd[PDX(va)] & PTE_P))
+		return 0;
+	return uvpt[PGNUM(va)];
+}
+
+void
+umain(int argc, char **argv)
+{
+	int i, r;
+
+	for (i = 0; i < NPAGES; i++) {
+		if (is_hole(i))
+			continue;
+		if ((r = sys_page_alloc(0, SRC + i * PGSIZE, PTE_P|PTE_U|PTE_W)) < 0)
+			panic("sys_page_alloc: %e", r);
+		SRC[i * PGSIZE] = i;
+	}
+
+	// Map the whole span; the holes stay holes.
+	if ((r = sys_page_map_range(0, SRC, 0, DST, NPAGES * PGSIZE,
+				    PTE_P|PTE_U|PTE_W)) < 0)
+		panic("sys_page_map_range: %e", r);
+	for (i = 0; i < NPAGES; i++) {
+		if (is_hole(i)) {
+			if (pte(DST + i * PGSIZE) & PTE_P)
+				panic("hole %d got mapped", i);
+			continue;
+		}
+		if (PTE_ADDR(pte(DST + i * PGSIZE)) != PTE_ADDR(pte(SRC + i * PGSIZE)))
+			panic("page %d maps a different frame", i);
+		if (DST[i * PGSIZE] != i)
+			panic("page %d has the wrong contents", i);
+	}
+
+	// Overlapping ranges in one address space are refused.
+	if ((r = sys_page_map_range(0, SRC, 0, SRC + PGSIZE, 2 * PGSIZE,
+				    PTE_P|PTE_U)) != -E_INVAL)
+		panic("overlapping map_range returned %e", r);
+
+	// Make the source read-only.  Its frames are shared with DST, so
+	// making them writable again is refused.
+	if ((r = sys_page_protect_range(0, SRC, NPAGES * PGSIZE, PTE_P|PTE_U)) < 0)
+		panic("sys_page_protect_range: %e", r);
+	for (i = 0; i < NPAGES; i++)
+		if (!is_hole(i) && (pte(SRC + i * PGSIZE) & PTE_W))
+			panic("page %d still writable", i);
+	if ((r = sys_page_map_range(0, SRC, 0, DST, NPAGES * PGSIZE,
+				    PTE_P|PTE_U|PTE_W)) != -E_INVAL)
+		panic("writable map of read-only range returned %e", r);
+	if ((r = sys_page_protect_range(0, SRC, NPAGES * PGSIZE,
+					PTE_P|PTE_U|PTE_W)) != -E_INVAL)
+		panic("protect of shared read-only range returned %e", r);
+
+	// Unmapping the copy leaves the source pages alone, after which
+	// the source may be made writable again.
+	if ((r = sys_page_unmap_range(0, DST, NPAGES * PGSIZE)) < 0)
+		panic("sys_page_unmap_range: %e", r);
+	for (i = 0; i < NPAGES; i++)
+		if (pte(DST + i * PGSIZE) & PTE_P)
+			panic("page %d still mapped", i);
+	if ((r = sys_page_protect_range(0, SRC, NPAGES * PGSIZE,
+					PTE_P|PTE_U|PTE_W)) < 0)
+		panic("sys_page_protect_range: %e", r);
+	for (i = 0; i < NPAGES; i++)
+		if (!is_hole(i))
+			SRC[i * PGSIZE] += 1;
+
+	if ((r = sys_page_unmap_range(0, SRC, NPAGES * PGSIZE)) < 0)
+		panic("sys_page_unmap_range: %e", r);
+	for (i = 0; i < NPAGES; i++)
+		if (pte(SRC + i * PGSIZE) & PTE_P)
+			panic("page %d still mapped", i);
+
+	cprintf("range syscalls ok\n");
+}
@@ -0,0 +1,50 @@
+// Test sleeping and timeouts: sys_sleep lasts at least as long as
+// asked, a receive with a timeout gives up when nobody sends, and
+// succeeds when somebody does.
+
+#include <inc/lib.h>
+
+#define MSEC	1000000ULL
+
+void
+umain(int argc, char **argv)
+{
+	envid_t parent = thisenv->env_id, child;
+	uint64_t t0, t;
+	int32_t r;
+
+	t0 = time_nsec();
+	if ((r = sys_sleep(50 * MSEC)) < 0)
+		panic("sys_sleep: %e", r);
+	if ((t = time_nsec() - t0) < 50 * MSEC)
+		panic("slept only %llu ns", t);
+	cprintf("sleep 50ms took %llu us\n", t / 1000);
+
+	// Nobody sends: time out.
+	t0 = time_nsec();
+	if ((r = ipc_recv_timeout(NULL, NULL, NULL, 30 * MSEC)) != -E_TIMEOUT)
+		panic("ipc_recv_timeout returned %e, want timeout", r);
+	if ((t = time_nsec() - t0) < 30 * MSEC)
+		panic("timed out after only %llu ns", t);
+
+	// A timeout is dropped by a call that does not block.
+	sys_set_timeout(0);
+	sys_getenvid();
+
+	// The child sends before the timeout and after a plain receive.
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		sys_sleep(20 * MSEC);
+		ipc_send(parent, 1, NULL, 0);
+		sys_sleep(20 * MSEC);
+		ipc_send(parent, 2, NULL, 0);
+		return;
+	}
+	if ((r = ipc_recv_timeout(NULL, NULL, NULL, 1000 * MSEC)) != 1)
+		panic("ipc_recv_timeout returned %d, want 1", r);
+	if ((r = ipc_recv(NULL, NULL, NULL)) != 2)
+		panic("ipc_recv returned %d, want 2", r);
+	wait(child);
+	cprintf("sleep and timeouts ok\n");
+}
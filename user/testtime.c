@@ -0,0 +1,40 @@
+// Test the clock page: time_nsec is calibrated, monotonic and needs no
+// system call, and agrees with the kernel's idea of elapsed time.
+
+#include <inc/lib.h>
+
+void
+umain(int argc, char **argv)
+{
+	uint64_t t0, t1, prev;
+	uint32_t calls;
+	int i;
+
+	if (uclock.cp_tsc_hz == 0)
+		panic("clock page not calibrated");
+	cprintf("TSC %llu Hz, boot epoch %u, now %u\n",
+		uclock.cp_tsc_hz, uclock.cp_boot_epoch, time_epoch());
+
+	// Reading the clock never traps.
+	calls = thisenv->env_syscalls;
+	prev = time_nsec();
+	for (i = 0; i < 1000; i++) {
+		t1 = time_nsec();
+		if (t1 < prev)
+			panic("time went backwards: %llu < %llu", t1, prev);
+		prev = t1;
+	}
+	if (thisenv->env_syscalls != calls)
+		panic("time_nsec made %d system calls",
+		      thisenv->env_syscalls - calls);
+
+	// Time passes while we yield.
+	t0 = time_nsec();
+	for (i = 0; i < 100; i++)
+		sys_yield();
+	t1 = time_nsec();
+	if (t1 <= t0)
+		panic("no time passed across 100 yields");
+	cprintf("100 yields took %llu ns\n", t1 - t0);
+	cprintf("time ok\n");
+}